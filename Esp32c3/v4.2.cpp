@@ -9,30 +9,49 @@
 #include <esp_task_wdt.h>
 #include <pgmspace.h>
 #include <time.h>
+#include "v4.2_render.h"
 
 // --- 配置 ---
-#define LED_PIN 8         // ESP32-C3 Mini-1-H4 的 GPIO8
-#define LED_COUNT 20      // LED 灯带数量
-Adafruit_NeoPixel strip(LED_COUNT, LED_PIN, NEO_GRB + NEO_KHZ800);
+// 灯带长度、引脚和颜色顺序在启动时从配置读取，这里只是默认值
+#define DEFAULT_LED_PIN 8     // ESP32-C3 Mini-1-H4 的 GPIO8
+#define DEFAULT_LED_COUNT 20  // LED 灯带数量
+#define MAX_LED_COUNT 1024
+Adafruit_NeoPixel strip(DEFAULT_LED_COUNT, DEFAULT_LED_PIN, NEO_GRB + NEO_KHZ800);
+
+// 支持的灯珠颜色顺序，名称与类型一一对应
+const char* const COLOR_ORDER_NAMES[] = { "GRB", "RGB", "BRG", "RBG", "GBR", "BGR" };
+const neoPixelType COLOR_ORDER_TYPES[] = { NEO_GRB, NEO_RGB, NEO_BRG, NEO_RBG, NEO_GBR, NEO_BGR };
+const uint8_t COLOR_ORDER_COUNT = 6;
 
 // MQTT 服务器配置（存储在 PROGMEM 中）
 const char MQTT_SERVER[] PROGMEM = "cn.mqtt.bambulab.com";
 const int MQTT_PORT = 8883;
+// 局域网直连打印机 Broker 时固定使用的用户名，密码为打印机访问码
+const char MQTT_LAN_USER[] PROGMEM = "bblp";
 
 // MQTT 主题（存储在 PROGMEM 中）
 const char MQTT_TOPIC_SUB_TEMPLATE[] PROGMEM = "device/{DEVICE_ID}/report";
 const char MQTT_TOPIC_PUB_TEMPLATE[] PROGMEM = "device/{DEVICE_ID}/request";
 
-// MQTT 缓冲文件
+// MQTT 缓冲文件（仅在内存环形缓冲区溢出时使用）
 const char* MQTT_RX_BUFFER_FILE = "/mqtt_rx_buffer.json";
 const char* MQTT_TX_BUFFER_FILE = "/mqtt_tx_buffer.json";
 const size_t MQTT_BUFFER_BLOCK_SIZE = 512;
 
+// MQTT 内存环形缓冲区大小（必须为 2 的幂）
+const size_t MQTT_RX_RING_SIZE = 4096;
+const size_t MQTT_TX_RING_SIZE = 1024;
+// 每轮最多合并处理的接收记录数（不超过 32）
+const uint8_t MQTT_COALESCE_MAX = 32;
+
 // 看门狗超时（秒）
 #define WATCHDOG_TIMEOUT 60
 
 // --- 全局对象 ---
 AsyncWebServer server(80);
+// /events 推送状态：状态变化时由主循环发送完整状态；订阅数有上限，超出时页面回落到轮询 /status
+AsyncEventSource events("/events");
+const uint8_t SSE_MAX_CLIENTS = 4;
 WiFiClientSecure espClient;
 PubSubClient mqttClient(espClient);
 WiFiManager wm;
@@ -41,6 +60,8 @@ WiFiManager wm;
 char uid[32] = "";
 char accessToken[256] = "";
 char deviceID[32] = "";
+char printerIP[40] = "";   // 填写后直连打印机局域网 Broker，不再经过云端
+char accessCode[16] = "";
 int globalBrightness = 50;
 char standbyMode[10] = "marquee";
 bool overlayMarquee = false;
@@ -49,6 +70,9 @@ uint32_t standbyBreathingColor = strip.Color(0, 0, 255);
 float progressBarBrightnessRatio = 1.0;
 float standbyBrightnessRatio = 1.0;
 unsigned long customPushallInterval = 30;
+uint16_t ledCount = DEFAULT_LED_COUNT;
+uint8_t ledPin = DEFAULT_LED_PIN;
+char ledColorOrder[4] = "GRB";
 
 // --- 状态变量 ---
 enum State {
@@ -67,6 +91,7 @@ int printPercent = 0;
 String gcodeState = "UNKNOWN";
 int remainingTime = 0;
 int layerNum = 0;
+int totalLayerNum = 0;
 DynamicJsonDocument printerState(4096);
 
 // 强制模式控制
@@ -90,15 +115,145 @@ unsigned long lastLedUpdate = 0;
 const long LED_UPDATE_INTERVAL = 16;
 int marqueePosition = 0;
 bool apClientConnected = false;
+// 页面内嵌了当前配置，每次重新生成都换一个 ETag；带上启动随机数，重启后不会误命中旧缓存
+char indexEtag[20] = "";
 bool pendingPushall = false;
+// 上次推送给 /events 订阅者的状态，这些字段都没变时不推送
+State pushedState = AP_MODE;
+ForcedMode pushedForcedMode = NONE;
+String pushedGcodeState = "";
+int pushedPrintPercent = -1;
+int pushedRemainingTime = -1;
+int pushedLayerNum = -1;
+uint32_t statusEventId = 0;
+// 网页请求清空缓冲时只置位，由 loop() 执行：环形缓冲区只允许 loop() 这一个生产者和消费者
+volatile bool clearMqttBuffersRequested = false;
 unsigned long lastMqttMessageTime = 0;
 const unsigned long MQTT_TIMEOUT = 300000;
+// 报告序号跟踪：只在序号断档、重连或长时间无报告时请求全量包
+uint32_t lastSequenceId = 0;
+bool sequenceSynced = false;
+uint32_t pushallSequenceId = 0;
+const unsigned long PUSHALL_MIN_INTERVAL = 5000; // 两次全量包请求的最小间隔（毫秒）
 
 bool testingLed = false;
 int testLedIndex = 0;
 unsigned long lastTestLedUpdate = 0;
 const long TEST_LED_INTERVAL = 50;
 
+// --- MQTT 内存环形缓冲区 ---
+// 单生产者/单消费者：生产者只推进 head，消费者只推进 tail，无需加锁。
+// 每条记录为 4 字节长度前缀 + 数据；放不下时才溢出到 LittleFS 文件。
+struct MqttRing {
+  uint8_t* data;
+  uint32_t mask;
+  volatile uint32_t head;
+  volatile uint32_t tail;
+  bool spilled; // 已有记录溢出到文件，后续记录也写入文件以保持顺序
+};
+uint8_t mqttRxRingData[MQTT_RX_RING_SIZE];
+uint8_t mqttTxRingData[MQTT_TX_RING_SIZE];
+MqttRing mqttRxRing = { mqttRxRingData, MQTT_RX_RING_SIZE - 1, 0, 0, false };
+MqttRing mqttTxRing = { mqttTxRingData, MQTT_TX_RING_SIZE - 1, 0, 0, false };
+
+// --- 增量 JSON 报告解析 ---
+// PubSubClient 把 PUBLISH 负载逐字节写入 reportTokenizer，边收边提取关心的字段：
+// 报告再大也只占用固定内存，回调触发时再压缩成一条小记录写入接收缓冲
+class ReportTokenizer : public Stream {
+public:
+  enum : uint8_t { F_GCODE_STATE = 1, F_MC_PERCENT = 2, F_REMAINING_TIME = 4, F_LAYER_NUM = 8, F_SEQUENCE_ID = 16, F_TOTAL_LAYER_NUM = 32 };
+
+  char gcodeState[16];
+  int32_t mcPercent;
+  int32_t remainingTime;
+  int32_t layerNum;
+  int32_t totalLayerNum;
+  uint32_t sequenceId;
+  uint8_t fields;
+
+  ReportTokenizer() { reset(); }
+  void reset();
+  size_t toRecord(char* out, size_t size) const;
+  bool complete() const { return closed; }   // 已收到完整的顶层对象
+
+  size_t write(uint8_t c) override;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+
+private:
+  void appendValue(char c);
+  void endValue();
+  uint8_t fieldForKey() const;
+
+  uint8_t depth;
+  uint32_t arrayBits;   // 第 n 层容器是否为数组
+  bool inString;
+  bool escaped;
+  bool readingKey;
+  bool expectKey;
+  bool inPrint;
+  bool closed;
+  uint8_t target;       // 当前值要写入的字段位，0 表示跳过
+  char key[20];
+  uint8_t keyLen;
+  char value[24];
+  uint8_t valueLen;
+};
+ReportTokenizer reportTokenizer;
+
+// --- 编译期生成的查找表（存放在 flash 中） ---
+// 单文件固件无法引用 v5 的 lut.h，以下是 Esp32c3/v5.0/c3-main/src/lut.cpp 中生成器的同步副本：
+// 修改时先改 lut.cpp 再同步过来，native 测试 lut_sync 会检查两者一致
+constexpr double LUT_HALF_PI = 1.5707963267948966;
+
+// sin 的泰勒展开，在 0 到 π/2 内误差小于 1e-5
+constexpr double lutSin(double x) {
+  return x - x * x * x / 6 + x * x * x * x * x / 120 - x * x * x * x * x * x * x / 5040 +
+         x * x * x * x * x * x * x * x * x / 362880;
+}
+
+// 牛顿迭代求五次方根，用于 x^2.2 = x^2 * x^0.2
+constexpr double lutRoot5(double x, double g, int n) {
+  return n == 0 ? g : lutRoot5(x, (4 * g + x / (g * g * g * g)) / 5, n - 1);
+}
+
+constexpr uint8_t lutGamma(int i) {
+  return i == 0 ? 0 : (uint8_t)(255.0 * (i / 255.0) * (i / 255.0) * lutRoot5(i / 255.0, 1.0, 24) + 0.5);
+}
+
+// 四分之一周期正弦，幅度 0-127
+constexpr uint8_t lutQuarterSine(int i) {
+  return (uint8_t)(127.0 * lutSin(i * LUT_HALF_PI / 64) + 0.5);
+}
+
+// HSV 色环：每 43 个 hue 一段，段内线性过渡，存表前做 gamma 校正
+constexpr uint32_t lutPack(int r, int g, int b) {
+  return ((uint32_t)lutGamma(r) << 16) | ((uint32_t)lutGamma(g) << 8) | lutGamma(b);
+}
+
+constexpr uint32_t lutRainbowSection(int section, int intensity) {
+  return section == 0 ? lutPack(255, intensity, 0)
+       : section == 1 ? lutPack(255 - intensity, 255, 0)
+       : section == 2 ? lutPack(0, 255, intensity)
+       : section == 3 ? lutPack(0, 255 - intensity, 255)
+       : section == 4 ? lutPack(intensity, 0, 255)
+       : lutPack(255, 0, 255 - intensity);
+}
+
+constexpr uint32_t lutRainbow(int hue) {
+  return lutRainbowSection(hue / 43, (hue % 43) * 6);
+}
+
+#define LUT_R4(f, i) f(i), f(i + 1), f(i + 2), f(i + 3)
+#define LUT_R16(f, i) LUT_R4(f, i), LUT_R4(f, i + 4), LUT_R4(f, i + 8), LUT_R4(f, i + 12)
+#define LUT_R64(f, i) LUT_R16(f, i), LUT_R16(f, i + 16), LUT_R16(f, i + 32), LUT_R16(f, i + 48)
+#define LUT_R256(f) LUT_R64(f, 0), LUT_R64(f, 64), LUT_R64(f, 128), LUT_R64(f, 192)
+
+const uint32_t RAINBOW_LUT[256] PROGMEM = { LUT_R256(lutRainbow) };
+const uint8_t GAMMA_LUT[256] PROGMEM = { LUT_R256(lutGamma) };
+const uint8_t QUARTER_SINE_LUT[65] PROGMEM = { LUT_R64(lutQuarterSine, 0), lutQuarterSine(64) };
+
 // --- HTML 内容（存储在 PROGMEM 中，已完全汉化） ---
 const char HTML_HEAD[] PROGMEM = R"(
 <!DOCTYPE html>
@@ -163,7 +318,7 @@ const char HTML_FORM_PART1[] PROGMEM = R"(
 <input type='number' id='progressBarBrightnessRatio' name='progressBarBrightnessRatio' min='0' max='1' step='0.1' value='%.1f' required>
 <label for='standbyBrightnessRatio'>待机亮度比例 (0.0-1.0)</label>
 <input type='number' id='standbyBrightnessRatio' name='standbyBrightnessRatio' min='0' max='1' step='0.1' value='%.1f' required>
-<label for='customPushallInterval'>全量包请求间隔 (10-600秒)</label>
+<label for='customPushallInterval'>无报告时请求全量包 (10-600秒)</label>
 <input type='number' id='customPushallInterval' name='customPushallInterval' min='10' max='600' value='%lu' required>
 <label><input type='checkbox' id='overlayMarquee' name='overlayMarquee'%s> 在进度条上叠加跑马灯</label>
 <button type='submit'>保存配置</button>
@@ -262,17 +417,36 @@ function fetchLog() {
       }
     });
 }
+function applyStatus(data) {
+  document.getElementById('status').textContent = data.status_text || '状态未知';
+  document.getElementById('switchModeSelect').value = data.forced_mode || 'none';
+}
 function fetchStatus() {
   fetch('/status')
     .then(response => response.ok ? response.json() : Promise.reject('状态加载失败：' + response.statusText))
-    .then(data => {
-       document.getElementById('status').textContent = data.status_text || '状态未知';
-       document.getElementById('switchModeSelect').value = data.forced_mode || 'none';
-    })
+    .then(applyStatus)
     .catch(error => {
        document.getElementById('status').textContent = '状态加载失败：' + error;
     });
 }
+let statusTimer = null;
+function startStatusPolling() {
+  if (statusTimer) return;
+  fetchStatus();
+  statusTimer = setInterval(fetchStatus, 5000);
+}
+// 优先用 /events 接收推送；浏览器不支持或订阅数已满时回落到轮询
+function connectEvents() {
+  if (!window.EventSource) {
+    startStatusPolling();
+    return;
+  }
+  const source = new EventSource('/events');
+  source.addEventListener('status', e => applyStatus(JSON.parse(e.data)));
+  source.onerror = () => {
+    if (source.readyState === EventSource.CLOSED) startStatusPolling();
+  };
+}
 function setupColorSync(pickerId, textId) {
   const picker = document.getElementById(pickerId);
   const textInput = document.getElementById(textId);
@@ -296,9 +470,8 @@ function setupColorSync(pickerId, textId) {
   });
 }
 window.onload = function() {
-  fetchStatus();
+  connectEvents();
   fetchLog();
-  setInterval(fetchStatus, 5000);
   setInterval(fetchLog, 7000);
   setupColorSync('progressBarColorPicker', 'progressBarColor');
   setupColorSync('standbyBreathingColorPicker', 'standbyBreathingColor');
@@ -317,25 +490,42 @@ void initStaticHtml();
 void writeProgmemToFile(File &file, const char* progmem_ptr);
 
 void reconnectMQTT();
+void configureMqttServer();
 void checkWiFiConnection();
 void sendPushall();
 
 void mqttCallback(char* topic, byte* payload, unsigned int length);
+void trackReportSequence(uint32_t seq);
+void ringReset(MqttRing &ring);
+void clearMqttBuffers();
+bool ringPush(MqttRing &ring, const uint8_t* data, uint32_t length);
+bool ringPeekAt(const MqttRing &ring, uint32_t &pos, char* out, size_t outSize, size_t &length);
+bool ringPeek(const MqttRing &ring, char* out, size_t outSize, size_t &length);
+void ringDrop(MqttRing &ring);
+void spillMqttRecord(const char* path, const uint8_t* data, uint32_t length);
 void writeMqttRxBuffer(const byte* data, unsigned int length);
 void writeMqttTxBuffer(const char* data, size_t length);
+uint8_t scanReportFields(const char* payload);
+void applyMqttReport(const char* payload, size_t length, DynamicJsonDocument &doc);
 void processMqttRxBuffer();
+void processMqttRxSpill(DynamicJsonDocument &doc);
 void processMqttTxBuffer();
+void processMqttTxSpill(const String &topicPub);
 
+void updateProgressEstimate(unsigned long now);
+uint32_t estimateProgressQ8(unsigned long now);
+void applyStripConfig();
+int findColorOrder(const char* name);
 void updateLED();
 void updateTestLed();
-uint32_t getRainbowColor(float position);
-uint32_t colorScale(uint32_t color, float scale);
 
 void handleRoot(AsyncWebServerRequest *request);
 void handleConfig(AsyncWebServerRequest *request);
 void handleTestLed(AsyncWebServerRequest *request);
 void handleLog(AsyncWebServerRequest *request);
 void handleStatus(AsyncWebServerRequest *request);
+void buildStatusJson(String &output);
+void pushStatusEvent();
 void handleClearCache(AsyncWebServerRequest *request);
 void handleResetConfig(AsyncWebServerRequest *request);
 void handleSwitchMode(AsyncWebServerRequest *request);
@@ -343,6 +533,7 @@ void handleRestart(AsyncWebServerRequest *request);
 void handleNotFound(AsyncWebServerRequest *request);
 
 bool isConfigValid();
+bool isLanMode();
 bool isPrinting();
 String getStateText(State state);
 String getForcedModeText(ForcedMode mode);
@@ -375,11 +566,11 @@ void setup() {
   Serial.print(F(" 已使用：")); Serial.print(LittleFS.usedBytes());
   Serial.print(F(" 剩余：")); Serial.println(LittleFS.totalBytes() - LittleFS.usedBytes());
 
-  if (LittleFS.exists(MQTT_RX_BUFFER_FILE)) LittleFS.remove(MQTT_RX_BUFFER_FILE);
-  if (LittleFS.exists(MQTT_TX_BUFFER_FILE)) LittleFS.remove(MQTT_TX_BUFFER_FILE);
+  clearMqttBuffers();
   Serial.println(F("已清除 MQTT 缓冲文件。"));
 
   loadConfig();
+  applyStripConfig();
   initStaticHtml();
 
   WiFi.mode(WIFI_STA);
@@ -443,10 +634,7 @@ void setup() {
   }
 
   if (isConfigValid()) {
-    espClient.setInsecure();
-    mqttClient.setServer(MQTT_SERVER, MQTT_PORT);
-    mqttClient.setCallback(mqttCallback);
-    mqttClient.setBufferSize(512);
+    configureMqttServer();
     Serial.println(F("MQTT 客户端已配置。"));
   } else {
     Serial.println(F("警告：MQTT 配置不完整，无法连接到 MQTT。"));
@@ -457,6 +645,15 @@ void setup() {
   server.on("/testLed", HTTP_POST, handleTestLed);
   server.on("/log", HTTP_GET, handleLog);
   server.on("/status", HTTP_GET, handleStatus);
+  events.setFilter([](AsyncWebServerRequest *request) {
+    return events.count() < SSE_MAX_CLIENTS;
+  });
+  events.onConnect([](AsyncEventSourceClient *client) {
+    String output;
+    buildStatusJson(output);
+    client->send(output.c_str(), "status", statusEventId);
+  });
+  server.addHandler(&events);
   server.on("/clearCache", HTTP_POST, handleClearCache);
   server.on("/resetConfig", HTTP_POST, handleResetConfig);
   server.on("/switchMode", HTTP_POST, handleSwitchMode);
@@ -486,6 +683,12 @@ void loop() {
 
   checkWiFiConnection();
 
+  if (clearMqttBuffersRequested) {
+    clearMqttBuffersRequested = false;
+    clearMqttBuffers();
+    Serial.println(F("已清除 MQTT 缓冲缓存。"));
+  }
+
   if (currentState != AP_MODE && WiFi.status() == WL_CONNECTED && isConfigValid()) {
     if (!mqttClient.connected()) {
       if (currentState != CONNECTING_PRINTER) {
@@ -494,6 +697,8 @@ void loop() {
       }
       reconnectMQTT();
     } else {
+      // PubSubClient 在一次 loop() 里读完整个包并触发回调；调用前分词器里还有数据，说明上一个包读到一半就失败了
+      reportTokenizer.reset();
       mqttClient.loop();
       processMqttTxBuffer();
     }
@@ -501,17 +706,15 @@ void loop() {
 
   processMqttRxBuffer();
 
-  if (currentState >= CONNECTED_PRINTER && mqttClient.connected() && currentMillis - lastPushallTime > (customPushallInterval * 1000)) {
-    sendPushall();
-    lastPushallTime = currentMillis;
-  } else if (currentState >= CONNECTED_PRINTER && currentMillis - lastPushallTime > (customPushallInterval * 1000)) {
+  // 不再按固定间隔轮询：只有长时间没有收到报告才视为过期
+  if (currentState >= CONNECTED_PRINTER && currentMillis - lastMqttMessageTime > (customPushallInterval * 1000) &&
+      currentMillis - lastPushallTime > (customPushallInterval * 1000)) {
     pendingPushall = true;
   }
 
-  if (pendingPushall && mqttClient.connected()) {
+  if (pendingPushall && mqttClient.connected() && currentMillis - lastPushallTime >= PUSHALL_MIN_INTERVAL) {
     sendPushall();
     pendingPushall = false;
-    lastPushallTime = currentMillis;
   }
 
   if (currentState != lastState) {
@@ -519,6 +722,7 @@ void loop() {
     Serial.print(F(" 切换到 ")); Serial.println(getStateText(currentState));
     lastState = currentState;
   }
+  pushStatusEvent();
 
   updateLED();
   updateTestLed();
@@ -553,6 +757,10 @@ void loadConfig() {
         accessToken[sizeof(accessToken) - 1] = '\0';
         strncpy(deviceID, doc["deviceID"] | "", sizeof(deviceID) - 1);
         deviceID[sizeof(deviceID) - 1] = '\0';
+        strncpy(printerIP, doc["printerIP"] | "", sizeof(printerIP) - 1);
+        printerIP[sizeof(printerIP) - 1] = '\0';
+        strncpy(accessCode, doc["accessCode"] | "", sizeof(accessCode) - 1);
+        accessCode[sizeof(accessCode) - 1] = '\0';
         globalBrightness = doc["brightness"] | 50;
         strncpy(standbyMode, doc["standbyMode"] | "marquee", sizeof(standbyMode) - 1);
         standbyMode[sizeof(standbyMode) - 1] = '\0';
@@ -562,6 +770,10 @@ void loadConfig() {
         progressBarBrightnessRatio = doc["progressBarBrightnessRatio"] | 1.0;
         standbyBrightnessRatio = doc["standbyBrightnessRatio"] | 1.0;
         customPushallInterval = doc["customPushallInterval"] | 30;
+        ledCount = constrain(doc["ledCount"] | DEFAULT_LED_COUNT, 1, MAX_LED_COUNT);
+        ledPin = constrain(doc["ledPin"] | DEFAULT_LED_PIN, 0, 21);
+        strncpy(ledColorOrder, doc["ledColorOrder"] | "GRB", sizeof(ledColorOrder) - 1);
+        ledColorOrder[sizeof(ledColorOrder) - 1] = '\0';
 
         strip.setBrightness(constrain(globalBrightness, 0, 255));
         Serial.println(F("配置加载成功。"));
@@ -584,6 +796,8 @@ void saveConfig() {
   doc["uid"] = uid;
   doc["accessToken"] = accessToken;
   doc["deviceID"] = deviceID;
+  doc["printerIP"] = printerIP;
+  doc["accessCode"] = accessCode;
   doc["brightness"] = globalBrightness;
   doc["standbyMode"] = standbyMode;
   doc["overlayMarquee"] = overlayMarquee;
@@ -592,6 +806,9 @@ void saveConfig() {
   doc["progressBarBrightnessRatio"] = progressBarBrightnessRatio;
   doc["standbyBrightnessRatio"] = standbyBrightnessRatio;
   doc["customPushallInterval"] = customPushallInterval;
+  doc["ledCount"] = ledCount;
+  doc["ledPin"] = ledPin;
+  doc["ledColorOrder"] = ledColorOrder;
 
   File configFile = LittleFS.open("/config.json", "w");
   if (configFile) {
@@ -642,6 +859,7 @@ void writeProgmemToFile(File &file, const char* progmem_ptr) {
 
 void initStaticHtml() {
   Serial.println(F("正在生成 /index.html..."));
+  indexEtag[0] = '\0';
   File file = LittleFS.open("/index.html", "w");
   if (!file) {
     Serial.println(F("错误：无法打开 /index.html 进行写入。"));
@@ -652,15 +870,21 @@ void initStaticHtml() {
 
   char tempBuffer[300];
 
-  snprintf_P(tempBuffer, sizeof(tempBuffer), PSTR("<label for='uid'>用户ID</label><input type='text' id='uid' name='uid' value='%s' required>"), uid);
+  snprintf_P(tempBuffer, sizeof(tempBuffer), PSTR("<label for='uid'>用户ID</label><input type='text' id='uid' name='uid' value='%s'>"), uid);
   file.print(tempBuffer);
 
-  snprintf_P(tempBuffer, sizeof(tempBuffer), PSTR("<label for='accessToken'>访问令牌</label><input type='text' id='accessToken' name='accessToken' maxlength='256' value='%s' required>"), accessToken);
+  snprintf_P(tempBuffer, sizeof(tempBuffer), PSTR("<label for='accessToken'>访问令牌</label><input type='text' id='accessToken' name='accessToken' maxlength='256' value='%s'>"), accessToken);
   file.print(tempBuffer);
 
   snprintf_P(tempBuffer, sizeof(tempBuffer), PSTR("<label for='deviceID'>设备序列号</label><input type='text' id='deviceID' name='deviceID' value='%s' required>"), deviceID);
   file.print(tempBuffer);
 
+  snprintf_P(tempBuffer, sizeof(tempBuffer), PSTR("<label for='printerIP'>打印机 IP（局域网直连，留空则使用云端）</label><input type='text' id='printerIP' name='printerIP' maxlength='39' value='%s'>"), printerIP);
+  file.print(tempBuffer);
+
+  snprintf_P(tempBuffer, sizeof(tempBuffer), PSTR("<label for='accessCode'>局域网访问码</label><input type='text' id='accessCode' name='accessCode' maxlength='15' value='%s'>"), accessCode);
+  file.print(tempBuffer);
+
   snprintf_P(tempBuffer, sizeof(tempBuffer), PSTR("<label for='brightness'>全局亮度 (0-255)</label><input type='number' id='brightness' name='brightness' min='0' max='255' value='%d' required>"), globalBrightness);
   file.print(tempBuffer);
 
@@ -685,16 +909,33 @@ void initStaticHtml() {
   snprintf_P(tempBuffer, sizeof(tempBuffer), PSTR("<label for='standbyBrightnessRatio'>待机亮度比例 (0.0-1.0)</label><input type='number' id='standbyBrightnessRatio' name='standbyBrightnessRatio' min='0' max='1' step='0.1' value='%.1f' required>"), standbyBrightnessRatio);
   file.print(tempBuffer);
 
-  snprintf_P(tempBuffer, sizeof(tempBuffer), PSTR("<label for='customPushallInterval'>全量包请求间隔 (10-600秒)</label><input type='number' id='customPushallInterval' name='customPushallInterval' min='10' max='600' value='%lu' required>"), customPushallInterval);
+  snprintf_P(tempBuffer, sizeof(tempBuffer), PSTR("<label for='customPushallInterval'>无报告时请求全量包 (10-600秒)</label><input type='number' id='customPushallInterval' name='customPushallInterval' min='10' max='600' value='%lu' required>"), customPushallInterval);
   file.print(tempBuffer);
 
   snprintf_P(tempBuffer, sizeof(tempBuffer), PSTR("<label><input type='checkbox' id='overlayMarquee' name='overlayMarquee'%s> 在进度条上叠加跑马灯</label>"), (overlayMarquee ? PSTR(" checked") : PSTR("")));
   file.print(tempBuffer);
 
+  snprintf_P(tempBuffer, sizeof(tempBuffer), PSTR("<label for='ledCount'>灯珠数量（重启后生效）</label><input type='number' id='ledCount' name='ledCount' min='1' max='%d' value='%u' required>"), MAX_LED_COUNT, ledCount);
+  file.print(tempBuffer);
+
+  snprintf_P(tempBuffer, sizeof(tempBuffer), PSTR("<label for='ledPin'>数据引脚 GPIO（重启后生效）</label><input type='number' id='ledPin' name='ledPin' min='0' max='21' value='%u' required>"), ledPin);
+  file.print(tempBuffer);
+
+  file.print(F("<label for='ledColorOrder'>颜色顺序（重启后生效）</label><select id='ledColorOrder' name='ledColorOrder'>"));
+  for (uint8_t i = 0; i < COLOR_ORDER_COUNT; i++) {
+    snprintf_P(tempBuffer, sizeof(tempBuffer), PSTR("<option value='%s'%s>%s</option>"),
+               COLOR_ORDER_NAMES[i], (strcmp(ledColorOrder, COLOR_ORDER_NAMES[i]) == 0 ? " selected" : ""), COLOR_ORDER_NAMES[i]);
+    file.print(tempBuffer);
+  }
+  file.print(F("</select>"));
+
   writeProgmemToFile(file, HTML_FORM_PART1 + strlen_P(HTML_FORM_PART1) - strlen_P("</div></div></div>"));
   writeProgmemToFile(file, HTML_SCRIPT);
 
   file.close();
+  static uint32_t bootNonce = esp_random();
+  static uint16_t generation = 0;
+  snprintf(indexEtag, sizeof(indexEtag), "\"%08lx-%u\"", (unsigned long)bootNonce, ++generation);
   Serial.println(F("已生成 /index.html"));
 }
 
@@ -724,10 +965,14 @@ void reconnectMQTT() {
   snprintf(macStr, sizeof(macStr), "%04X%08X", (uint16_t)(mac >> 32), (uint32_t)mac);
   String clientID = "BambuLED-" + String(macStr);
   Serial.print(clientID);
+  char lanUser[8];
+  strcpy_P(lanUser, MQTT_LAN_USER);
+  const char* mqttUser = isLanMode() ? lanUser : uid;
+  const char* mqttPassword = isLanMode() ? accessCode : accessToken;
   Serial.print(F(" 用户："));
-  Serial.println(uid);
+  Serial.println(mqttUser);
 
-  if (mqttClient.connect(clientID.c_str(), uid, accessToken)) {
+  if (mqttClient.connect(clientID.c_str(), mqttUser, mqttPassword)) {
     Serial.println(F("MQTT 连接成功！"));
     currentState = CONNECTED_PRINTER;
 
@@ -743,8 +988,9 @@ void reconnectMQTT() {
       Serial.println(F("错误：无法订阅报告主题。"));
     }
 
+    reportTokenizer.reset();
+    sequenceSynced = false;
     sendPushall();
-    lastPushallTime = currentMillis;
     reconnectDelay = 1000;
   } else {
     Serial.print(F("MQTT 连接失败，错误码="));
@@ -757,10 +1003,27 @@ void reconnectMQTT() {
   }
 }
 
+// 按模式设置 Broker：局域网直连打印机，否则连接拓竹云
+void configureMqttServer() {
+  espClient.setInsecure();
+  if (isLanMode()) {
+    mqttClient.setServer(printerIP, MQTT_PORT);
+    Serial.print(F("MQTT 局域网模式，打印机："));
+    Serial.println(printerIP);
+  } else {
+    mqttClient.setServer(MQTT_SERVER, MQTT_PORT);
+  }
+  mqttClient.setCallback(mqttCallback);
+  mqttClient.setStream(reportTokenizer);
+  mqttClient.setBufferSize(512);
+}
+
 void sendPushall() {
   DynamicJsonDocument pushall_request(256);
   JsonObject pushing = pushall_request.createNestedObject("pushing");
-  pushing["sequence_id"] = String(millis());
+  lastPushallTime = millis();
+  pushallSequenceId = lastPushallTime;
+  pushing["sequence_id"] = String(pushallSequenceId);
   pushing["command"] = "pushall";
   pushing["version"] = 1;
   pushing["push_target"] = 1;
@@ -787,13 +1050,251 @@ void mqttCallback(char* topic, byte* payload, unsigned int length) {
   Serial.print(F("] 长度："));
   Serial.println(length);
 
-  writeMqttRxBuffer(payload, length);
+  // 负载没有收全（读包中途超时或 JSON 被截断）时分词器里只有半份报告，整份丢弃并请求全量包补齐
+  if (!reportTokenizer.complete()) {
+    Serial.println(F("报告不完整，已丢弃。"));
+    reportTokenizer.reset();
+    pendingPushall = true;
+    return;
+  }
+
+  // 负载已由 reportTokenizer 边收边解析；报告超过缓冲区时 payload 是截断的，这里不再使用
+  if (reportTokenizer.fields & ReportTokenizer::F_SEQUENCE_ID) {
+    trackReportSequence(reportTokenizer.sequenceId);
+  }
+  char record[160];
+  size_t recordLength = reportTokenizer.toRecord(record, sizeof(record));
+  if (recordLength > 0) {
+    writeMqttRxBuffer(reinterpret_cast<const byte*>(record), recordLength);
+  }
+  reportTokenizer.reset();
 }
 
-void writeMqttRxBuffer(const byte* data, unsigned int length) {
-  File file = LittleFS.open(MQTT_RX_BUFFER_FILE, "a");
+// 序号不连续说明中间丢了增量报告，需要一次全量包重新对齐
+void trackReportSequence(uint32_t seq) {
+  if (seq == pushallSequenceId) {
+    // 全量包应答带回的是我们发出的序号，之后以下一条报告重新对齐
+    sequenceSynced = false;
+    return;
+  }
+  if (sequenceSynced && seq != lastSequenceId && seq != lastSequenceId + 1) {
+    Serial.print(F("报告序号断档："));
+    Serial.print(lastSequenceId);
+    Serial.print(F(" -> "));
+    Serial.println(seq);
+    pendingPushall = true;
+  }
+  lastSequenceId = seq;
+  sequenceSynced = true;
+}
+
+void ReportTokenizer::reset() {
+  gcodeState[0] = '\0';
+  mcPercent = remainingTime = layerNum = totalLayerNum = 0;
+  sequenceId = 0;
+  fields = 0;
+  depth = 0;
+  arrayBits = 0;
+  inString = escaped = readingKey = expectKey = inPrint = closed = false;
+  target = 0;
+  keyLen = valueLen = 0;
+  key[0] = '\0';
+}
+
+uint8_t ReportTokenizer::fieldForKey() const {
+  if (strcmp(key, "gcode_state") == 0) return F_GCODE_STATE;
+  if (strcmp(key, "mc_percent") == 0) return F_MC_PERCENT;
+  if (strcmp(key, "mc_remaining_time") == 0) return F_REMAINING_TIME;
+  if (strcmp(key, "layer_num") == 0) return F_LAYER_NUM;
+  if (strcmp(key, "total_layer_num") == 0) return F_TOTAL_LAYER_NUM;
+  if (strcmp(key, "sequence_id") == 0) return F_SEQUENCE_ID;
+  return 0;
+}
+
+void ReportTokenizer::appendValue(char c) {
+  if (target && valueLen < sizeof(value) - 1) value[valueLen++] = c;
+}
+
+void ReportTokenizer::endValue() {
+  if (!target) return;
+  value[valueLen] = '\0';
+  switch (target) {
+    case F_GCODE_STATE: strlcpy(gcodeState, value, sizeof(gcodeState)); break;
+    case F_MC_PERCENT: mcPercent = atol(value); break;
+    case F_REMAINING_TIME: remainingTime = atol(value); break;
+    case F_LAYER_NUM: layerNum = atol(value); break;
+    case F_TOTAL_LAYER_NUM: totalLayerNum = atol(value); break;
+    case F_SEQUENCE_ID: sequenceId = strtoul(value, nullptr, 10); break;
+  }
+  fields |= target;
+  target = 0;
+  valueLen = 0;
+}
+
+size_t ReportTokenizer::write(uint8_t c) {
+  if (inString) {
+    if (escaped) {
+      escaped = false;
+    } else if (c == '\\') {
+      escaped = true;
+      return 1;
+    } else if (c == '"') {
+      inString = false;
+      if (readingKey) {
+        readingKey = false;
+        key[keyLen] = '\0';
+      } else {
+        endValue();
+      }
+      return 1;
+    }
+    if (!readingKey) {
+      appendValue(c);
+    } else if (keyLen < sizeof(key) - 1) {
+      key[keyLen++] = c;
+    } else {
+      key[0] = '\0';  // 超长的键不可能是关心的字段
+      keyLen = 0;
+    }
+    return 1;
+  }
+
+  switch (c) {
+    case '"':
+      inString = true;
+      readingKey = expectKey;
+      keyLen = 0;
+      break;
+    case '{':
+    case '[':
+      if (c == '{' && depth == 1 && strcmp(key, "print") == 0) inPrint = true;
+      target = 0;
+      if (depth < 32) {
+        if (c == '[') arrayBits |= 1UL << depth;
+        else arrayBits &= ~(1UL << depth);
+      }
+      if (depth < 255) depth++;
+      expectKey = (c == '{');
+      break;
+    case '}':
+    case ']':
+      endValue();
+      if (depth > 0 && --depth == 0) closed = true;
+      if (depth < 2) inPrint = false;
+      expectKey = false;
+      break;
+    case ':':
+      expectKey = false;
+      target = (inPrint && depth == 2) ? fieldForKey() : 0;
+      valueLen = 0;
+      break;
+    case ',':
+      endValue();
+      expectKey = depth > 0 && depth <= 32 && !(arrayBits & (1UL << (depth - 1)));
+      break;
+    case ' ':
+    case '\t':
+    case '\r':
+    case '\n':
+      break;
+    default:
+      appendValue(c);  // 数字、true/false/null 等标量
+      break;
+  }
+  return 1;
+}
+
+// 把提取到的字段写成 {"print":{...}}，没有状态字段时返回 0
+size_t ReportTokenizer::toRecord(char* out, size_t size) const {
+  if (!(fields & (F_GCODE_STATE | F_MC_PERCENT | F_REMAINING_TIME | F_LAYER_NUM | F_TOTAL_LAYER_NUM))) return 0;
+  int n = snprintf(out, size, "{\"print\":{");
+  const char* sep = "";
+  if (fields & F_GCODE_STATE) { n += snprintf(out + n, size - n, "%s\"gcode_state\":\"%s\"", sep, gcodeState); sep = ","; }
+  if (fields & F_MC_PERCENT) { n += snprintf(out + n, size - n, "%s\"mc_percent\":%ld", sep, (long)mcPercent); sep = ","; }
+  if (fields & F_REMAINING_TIME) { n += snprintf(out + n, size - n, "%s\"mc_remaining_time\":%ld", sep, (long)remainingTime); sep = ","; }
+  if (fields & F_LAYER_NUM) { n += snprintf(out + n, size - n, "%s\"layer_num\":%ld", sep, (long)layerNum); sep = ","; }
+  if (fields & F_TOTAL_LAYER_NUM) { n += snprintf(out + n, size - n, "%s\"total_layer_num\":%ld", sep, (long)totalLayerNum); }
+  n += snprintf(out + n, size - n, "}}");
+  return (n > 0 && (size_t)n < size) ? n : 0;
+}
+
+// --- MQTT 环形缓冲区函数 ---
+void ringReset(MqttRing &ring) {
+  ring.head = 0;
+  ring.tail = 0;
+  ring.spilled = false;
+}
+
+// 删除溢出文件并清空两个环形缓冲区；只能在 loop() 所在任务调用
+void clearMqttBuffers() {
+  if (LittleFS.exists(MQTT_RX_BUFFER_FILE)) LittleFS.remove(MQTT_RX_BUFFER_FILE);
+  if (LittleFS.exists(MQTT_TX_BUFFER_FILE)) LittleFS.remove(MQTT_TX_BUFFER_FILE);
+  ringReset(mqttRxRing);
+  ringReset(mqttTxRing);
+}
+
+static void ringCopyIn(MqttRing &ring, uint32_t pos, const uint8_t* src, size_t len) {
+  size_t offset = pos & ring.mask;
+  size_t first = min(len, (size_t)ring.mask + 1 - offset);
+  memcpy(ring.data + offset, src, first);
+  memcpy(ring.data, src + first, len - first);
+}
+
+static void ringCopyOut(const MqttRing &ring, uint32_t pos, uint8_t* dst, size_t len) {
+  size_t offset = pos & ring.mask;
+  size_t first = min(len, (size_t)ring.mask + 1 - offset);
+  memcpy(dst, ring.data + offset, first);
+  memcpy(dst + first, ring.data, len - first);
+}
+
+bool ringPush(MqttRing &ring, const uint8_t* data, uint32_t length) {
+  uint32_t head = ring.head;
+  uint32_t used = head - ring.tail;
+  if (sizeof(length) + length > ring.mask + 1 - used) {
+    return false;
+  }
+  ringCopyIn(ring, head, reinterpret_cast<const uint8_t*>(&length), sizeof(length));
+  ringCopyIn(ring, head + sizeof(length), data, length);
+  ring.head = head + sizeof(length) + length; // 数据写完后再发布 head
+  return true;
+}
+
+// 读取 pos 处的记录但不出队，并把 pos 移到下一条；记录超过 outSize 时只返回长度，不复制数据
+bool ringPeekAt(const MqttRing &ring, uint32_t &pos, char* out, size_t outSize, size_t &length) {
+  if (ring.head == pos) {
+    return false;
+  }
+  uint32_t recordLength;
+  ringCopyOut(ring, pos, reinterpret_cast<uint8_t*>(&recordLength), sizeof(recordLength));
+  length = recordLength;
+  if (recordLength <= outSize) {
+    ringCopyOut(ring, pos + sizeof(recordLength), reinterpret_cast<uint8_t*>(out), recordLength);
+  }
+  pos += sizeof(recordLength) + recordLength;
+  return true;
+}
+
+// 读取队首记录但不出队
+bool ringPeek(const MqttRing &ring, char* out, size_t outSize, size_t &length) {
+  uint32_t pos = ring.tail;
+  return ringPeekAt(ring, pos, out, outSize, length);
+}
+
+void ringDrop(MqttRing &ring) {
+  uint32_t tail = ring.tail;
+  if (ring.head == tail) {
+    return;
+  }
+  uint32_t recordLength;
+  ringCopyOut(ring, tail, reinterpret_cast<uint8_t*>(&recordLength), sizeof(recordLength));
+  ring.tail = tail + sizeof(recordLength) + recordLength;
+}
+
+void spillMqttRecord(const char* path, const uint8_t* data, uint32_t length) {
+  File file = LittleFS.open(path, "a");
   if (!file) {
-    Serial.println(F("错误：无法打开 MQTT 接收缓冲文件进行写入。"));
+    Serial.print(F("错误：无法打开 MQTT 溢出缓冲文件进行写入："));
+    Serial.println(path);
     return;
   }
   file.write(reinterpret_cast<const uint8_t*>(&length), sizeof(length));
@@ -801,29 +1302,149 @@ void writeMqttRxBuffer(const byte* data, unsigned int length) {
   file.close();
 
   if (bytesWritten != length) {
-    Serial.print(F("错误：无法完整写入消息到接收缓冲。已写入："));
+    Serial.print(F("错误：无法完整写入消息到溢出缓冲。已写入："));
     Serial.println(bytesWritten);
   }
 }
 
+void writeMqttRxBuffer(const byte* data, unsigned int length) {
+  if (length == 0 || length > MQTT_BUFFER_BLOCK_SIZE) {
+    Serial.print(F("错误：MQTT 消息长度无效，已丢弃："));
+    Serial.println(length);
+    return;
+  }
+  if (!mqttRxRing.spilled && ringPush(mqttRxRing, data, length)) {
+    return;
+  }
+  if (!mqttRxRing.spilled) {
+    Serial.println(F("接收环形缓冲区已满，溢出到闪存。"));
+    mqttRxRing.spilled = true;
+  }
+  spillMqttRecord(MQTT_RX_BUFFER_FILE, data, length);
+}
+
 void writeMqttTxBuffer(const char* data, size_t length) {
-  File file = LittleFS.open(MQTT_TX_BUFFER_FILE, "a");
-  if (!file) {
-    Serial.println(F("错误：无法打开 MQTT 发送缓冲文件进行写入。"));
+  if (length == 0 || length > MQTT_BUFFER_BLOCK_SIZE) {
+    Serial.print(F("错误：MQTT 发送消息长度无效，已丢弃："));
+    Serial.println(length);
     return;
   }
-  file.write(reinterpret_cast<const uint8_t*>(&length), sizeof(length));
-  size_t bytesWritten = file.write(reinterpret_cast<const uint8_t*>(data), length);
-  file.close();
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+  if (!mqttTxRing.spilled && ringPush(mqttTxRing, bytes, length)) {
+    return;
+  }
+  if (!mqttTxRing.spilled) {
+    Serial.println(F("发送环形缓冲区已满，溢出到闪存。"));
+    mqttTxRing.spilled = true;
+  }
+  spillMqttRecord(MQTT_TX_BUFFER_FILE, bytes, length);
+}
 
-  if (bytesWritten != length) {
-    Serial.print(F("错误：无法完整写入消息到发送缓冲。已写入："));
-    Serial.println(bytesWritten);
+// 不解析 JSON，只扫描报告中出现了哪些关心的字段（每个字段一位）
+uint8_t scanReportFields(const char* payload) {
+  static const char* const keys[] = { "\"gcode_state\"", "\"mc_percent\"", "\"mc_remaining_time\"", "\"layer_num\"", "\"total_layer_num\"" };
+  uint8_t mask = 0;
+  for (uint8_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+    if (strstr(payload, keys[i]) != nullptr) mask |= 1 << i;
+  }
+  return mask;
+}
+
+void applyMqttReport(const char* payload, size_t length, DynamicJsonDocument &doc) {
+  doc.clear();
+  DeserializationError error = deserializeJson(doc, payload, length);
+
+  if (error) {
+    Serial.print(F("错误：无法解析接收缓冲中的 JSON："));
+    Serial.println(error.c_str());
+    return;
+  }
+
+  if (doc.containsKey("print")) {
+    JsonObject printData = doc["print"];
+    for (JsonPair kv : printData) {
+      printerState[kv.key().c_str()] = kv.value();
+    }
+
+    gcodeState = printerState["gcode_state"] | "UNKNOWN";
+    printPercent = printerState["mc_percent"] | 0;
+    remainingTime = printerState["mc_remaining_time"] | 0;
+    layerNum = printerState["layer_num"] | 0;
+    totalLayerNum = printerState["total_layer_num"] | 0;
+    updateProgressEstimate(millis());
+
+    if (forcedMode == NONE) {
+      State newState = currentState;
+      if (gcodeState == "RUNNING") newState = PRINTING;
+      else if (gcodeState == "FAILED" || gcodeState == "STOP") newState = ERROR;
+      else if (gcodeState == "FINISH" || printPercent >= 99) {
+        newState = CONNECTED_PRINTER;
+        forcedMode = NONE; // 重置强制模式
+      } else if (gcodeState == "IDLE" || gcodeState == "PAUSE") newState = CONNECTED_PRINTER;
+      else if (currentState < CONNECTED_PRINTER) newState = currentState;
+
+      if (newState != currentState) currentState = newState;
+    }
   }
 }
 
 void processMqttRxBuffer() {
+  if (mqttRxRing.head == mqttRxRing.tail && !mqttRxRing.spilled) {
+    return;
+  }
+
+  char buffer[MQTT_BUFFER_BLOCK_SIZE + 1];
+  size_t length;
+  DynamicJsonDocument doc(4096);
+
+  // 第一遍：只扫描积压记录包含的字段，不做 JSON 解析
+  uint8_t fieldMasks[MQTT_COALESCE_MAX];
+  uint8_t count = 0;
+  uint32_t pos = mqttRxRing.tail;
+  while (count < MQTT_COALESCE_MAX && ringPeekAt(mqttRxRing, pos, buffer, MQTT_BUFFER_BLOCK_SIZE, length)) {
+    if (length == 0 || length > MQTT_BUFFER_BLOCK_SIZE) {
+      fieldMasks[count++] = 0;
+      continue;
+    }
+    buffer[length] = '\0';
+    fieldMasks[count++] = scanReportFields(buffer);
+  }
+
+  // 从后往前：只有提供了后续记录中没有的字段的记录才需要解析，其余直接丢弃
+  uint32_t needed = 0;
+  uint8_t laterFields = 0;
+  for (int i = count - 1; i >= 0; i--) {
+    if (fieldMasks[i] & ~laterFields) needed |= 1UL << i;
+    laterFields |= fieldMasks[i];
+  }
+
+  // 第二遍：按顺序应用需要的记录，保证每个字段最终取最新值
+  uint8_t dropped = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    if (!ringPeek(mqttRxRing, buffer, MQTT_BUFFER_BLOCK_SIZE, length)) break;
+    ringDrop(mqttRxRing);
+    if (!(needed & (1UL << i))) {
+      dropped++;
+      continue;
+    }
+    buffer[length] = '\0';
+    applyMqttReport(buffer, length, doc);
+    yield();
+  }
+  if (dropped > 0) {
+    Serial.print(F("已合并丢弃过期 MQTT 报告："));
+    Serial.println(dropped);
+  }
+
+  if (mqttRxRing.spilled && mqttRxRing.head == mqttRxRing.tail) {
+    processMqttRxSpill(doc);
+  }
+}
+
+// 处理溢出到闪存的接收记录（环形缓冲区清空后才会调用）
+void processMqttRxSpill(DynamicJsonDocument &doc) {
   if (!LittleFS.exists(MQTT_RX_BUFFER_FILE)) {
+    mqttRxRing.spilled = false;
     return;
   }
 
@@ -832,7 +1453,6 @@ void processMqttRxBuffer() {
   size_t bytesRead;
   bool processedAny = false;
   size_t processedOffset = 0;
-  DynamicJsonDocument doc(4096);
 
   while (true) {
     File file = LittleFS.open(MQTT_RX_BUFFER_FILE, "r");
@@ -854,6 +1474,8 @@ void processMqttRxBuffer() {
 
     if (bytesRead == 0 || bytesRead > MQTT_BUFFER_BLOCK_SIZE) {
       offset += sizeof(bytesRead) + bytesRead;
+      processedOffset = offset;
+      processedAny = true;
       file.close();
       continue;
     }
@@ -868,41 +1490,7 @@ void processMqttRxBuffer() {
     }
 
     buffer[bytesRead] = '\0';
-    doc.clear();
-    DeserializationError error = deserializeJson(doc, buffer, bytesRead);
-
-    if (error) {
-      Serial.print(F("错误：无法解析接收缓冲中的 JSON："));
-      Serial.println(error.c_str());
-      processedOffset = offset = expectedOffsetEnd;
-      processedAny = true;
-      continue;
-    }
-
-    if (doc.containsKey("print")) {
-      JsonObject printData = doc["print"];
-      for (JsonPair kv : printData) {
-        printerState[kv.key().c_str()] = kv.value();
-      }
-
-      gcodeState = printerState["gcode_state"] | "UNKNOWN";
-      printPercent = printerState["mc_percent"] | 0;
-      remainingTime = printerState["mc_remaining_time"] | 0;
-      layerNum = printerState["layer_num"] | 0;
-
-      if (forcedMode == NONE) {
-        State newState = currentState;
-        if (gcodeState == "RUNNING") newState = PRINTING;
-        else if (gcodeState == "FAILED" || gcodeState == "STOP") newState = ERROR;
-        else if (gcodeState == "FINISH" || printPercent >= 99) {
-          newState = CONNECTED_PRINTER;
-          forcedMode = NONE; // 重置强制模式
-        } else if (gcodeState == "IDLE" || gcodeState == "PAUSE") newState = CONNECTED_PRINTER;
-        else if (currentState < CONNECTED_PRINTER) newState = currentState;
-
-        if (newState != currentState) currentState = newState;
-      }
-    }
+    applyMqttReport(buffer, bytesRead, doc);
 
     processedOffset = offset = expectedOffsetEnd;
     processedAny = true;
@@ -920,7 +1508,7 @@ void processMqttRxBuffer() {
 
     if (processedOffset >= totalSize) {
       if (LittleFS.remove(MQTT_RX_BUFFER_FILE)) {
-        // Serial.println(F("已清理处理过的接收缓冲文件。"));
+        mqttRxRing.spilled = false;
       } else {
         Serial.println(F("错误：无法删除处理过的接收缓冲文件。"));
       }
@@ -984,21 +1572,46 @@ void processMqttRxBuffer() {
 }
 
 void processMqttTxBuffer() {
-  if (!mqttClient.connected() || !LittleFS.exists(MQTT_TX_BUFFER_FILE)) {
+  if (!mqttClient.connected() || (mqttTxRing.head == mqttTxRing.tail && !mqttTxRing.spilled)) {
     return;
   }
 
-  size_t offset = 0;
   char buffer[MQTT_BUFFER_BLOCK_SIZE + 1];
-  size_t bytesRead;
-  bool sentAny = false;
-  size_t processedOffset = 0;
+  size_t length;
 
   char topicPubBuffer[64];
   strcpy_P(topicPubBuffer, MQTT_TOPIC_PUB_TEMPLATE);
   String topicPub = String(topicPubBuffer);
   topicPub.replace("{DEVICE_ID}", deviceID);
 
+  while (ringPeek(mqttTxRing, buffer, MQTT_BUFFER_BLOCK_SIZE, length)) {
+    if (length > 0 && length <= MQTT_BUFFER_BLOCK_SIZE &&
+        !mqttClient.publish(topicPub.c_str(), reinterpret_cast<const uint8_t*>(buffer), length)) {
+      Serial.println(F("错误：无法从发送缓冲发布消息。"));
+      return;
+    }
+    ringDrop(mqttTxRing);
+    yield();
+  }
+
+  if (mqttTxRing.spilled) {
+    processMqttTxSpill(topicPub);
+  }
+}
+
+// 发送溢出到闪存的记录（环形缓冲区清空后才会调用）
+void processMqttTxSpill(const String &topicPub) {
+  if (!LittleFS.exists(MQTT_TX_BUFFER_FILE)) {
+    mqttTxRing.spilled = false;
+    return;
+  }
+
+  size_t offset = 0;
+  char buffer[MQTT_BUFFER_BLOCK_SIZE + 1];
+  size_t bytesRead;
+  bool sentAny = false;
+  size_t processedOffset = 0;
+
   while (true) {
     File file = LittleFS.open(MQTT_TX_BUFFER_FILE, "r");
     if (!file || offset >= file.size()) {
@@ -1019,6 +1632,8 @@ void processMqttTxBuffer() {
 
     if (bytesRead == 0 || bytesRead > MQTT_BUFFER_BLOCK_SIZE) {
       offset += sizeof(bytesRead) + bytesRead;
+      processedOffset = offset;
+      sentAny = true;
       file.close();
       continue;
     }
@@ -1054,7 +1669,7 @@ void processMqttTxBuffer() {
 
     if (processedOffset >= totalSize) {
       if (LittleFS.remove(MQTT_TX_BUFFER_FILE)) {
-        // Serial.println(F("已清理处理过的发送缓冲文件。"));
+        mqttTxRing.spilled = false;
       } else {
         Serial.println(F("错误：无法删除处理过的发送缓冲文件。"));
       }
@@ -1117,152 +1732,176 @@ void processMqttTxBuffer() {
   }
 }
 
+// --- 进度估算 ---
+// mc_percent 只有整数且只随报告更新。估算器以最近一次报告为锚点，按剩余时间和本地时钟
+// 线性推进，层数用来细化百分比内的位置；输出为 Q8 百分比（25600 表示 100%），单调不减
+struct ProgressEstimator {
+  uint32_t anchorQ8;     // 锚点进度
+  unsigned long anchorMs;
+  unsigned long spanMs;  // 锚点到预计完成的时长，0 表示不外推
+  uint32_t ceilingQ8;    // 不超过打印机下一次会报告的整数百分比
+  uint32_t lastQ8;       // 上次输出，保证单调
+  int percent;           // 锚点对应的原始报告值，用于判断报告是否有变化
+  int remaining;
+  int layer;
+  bool running;          // 锚点时是否在打印，暂停/恢复时需要重新锚定
+};
+ProgressEstimator progressEstimator = { 0, 0, 0, 0, 0, -1, -1, -1, false };
+
+const uint32_t PROGRESS_FULL_Q8 = 100UL << 8;
+
+// 报告合并进 printerState 后调用；字段都没变时保留原锚点，避免外推被反复拉回。
+// 暂停/恢复时也要重新锚定，暂停期间不能算作已经过去的打印时间
+void updateProgressEstimate(unsigned long now) {
+  ProgressEstimator &e = progressEstimator;
+  int percent = constrain(printPercent, 0, 100);
+  bool running = gcodeState == "RUNNING";
+  if (percent == e.percent && remainingTime == e.remaining && layerNum == e.layer && running == e.running) return;
+
+  uint32_t reportedQ8 = (uint32_t)percent << 8;
+  uint32_t ceilingQ8 = percent >= 100 ? PROGRESS_FULL_Q8 : reportedQ8 + 255;
+  // 层数只在当前整数百分比内细化位置
+  if (totalLayerNum > 0 && layerNum > 0) {
+    uint32_t layerQ8 = (uint32_t)constrain(layerNum, 0, totalLayerNum) * PROGRESS_FULL_Q8 / totalLayerNum;
+    reportedQ8 = constrain(layerQ8, reportedQ8, ceilingQ8);
+  }
+
+  // 进度明显倒退（新的一次打印）时重新开始，否则保持单调
+  if (reportedQ8 + 512 < e.lastQ8) e.lastQ8 = 0;
+  e.anchorQ8 = max(reportedQ8, min(e.lastQ8, ceilingQ8));
+  e.anchorMs = now;
+  e.spanMs = remainingTime > 0 ? (unsigned long)remainingTime * 60000UL : 0;
+  e.ceilingQ8 = ceilingQ8;
+  e.percent = percent;
+  e.remaining = remainingTime;
+  e.layer = layerNum;
+  e.running = running;
+}
+
+// 渲染每帧调用，不需要等待下一次报告
+uint32_t estimateProgressQ8(unsigned long now) {
+  ProgressEstimator &e = progressEstimator;
+  if (currentState != PRINTING) {
+    e.lastQ8 = (uint32_t)constrain(printPercent, 0, 100) << 8;
+    return e.lastQ8;
+  }
+  // 暂停等非运行状态下冻结在当前位置，不倒退也不外推
+  if (gcodeState != "RUNNING") return e.lastQ8;
+  uint32_t estimate = e.anchorQ8;
+  if (e.spanMs > 0) {
+    unsigned long elapsed = min(now - e.anchorMs, e.spanMs);
+    estimate += (uint64_t)(PROGRESS_FULL_Q8 - e.anchorQ8) * elapsed / e.spanMs;
+  }
+  estimate = min(estimate, e.ceilingQ8);
+  e.lastQ8 = max(e.lastQ8, estimate);
+  return e.lastQ8;
+}
+
 // --- LED 控制函数 ---
-uint32_t colorScale(uint32_t color, float scale) {
-  scale = constrain(scale, 0.0f, 1.0f);
-  uint8_t r = (uint8_t)(((color >> 16) & 0xFF) * scale);
-  uint8_t g = (uint8_t)(((color >> 8) & 0xFF) * scale);
-  uint8_t b = (uint8_t)((color & 0xFF) * scale);
-  return strip.Color(r, g, b);
+int findColorOrder(const char* name) {
+  for (uint8_t i = 0; i < COLOR_ORDER_COUNT; i++) {
+    if (strcmp(name, COLOR_ORDER_NAMES[i]) == 0) return i;
+  }
+  return -1;
 }
 
-uint32_t getRainbowColor(float position) {
-  int hue = (int)(position * 255);
-  int section = hue / 43;
-  int remainder = hue - (section * 43);
-  int intensity = remainder * 6;
-  switch (section) {
-    case 0: return strip.Color(255, intensity, 0);
-    case 1: return strip.Color(255 - intensity, 255, 0);
-    case 2: return strip.Color(0, 255, intensity);
-    case 3: return strip.Color(0, 255 - intensity, 255);
-    case 4: return strip.Color(intensity, 0, 255);
-    default: return strip.Color(255, 0, 255 - intensity);
+// 启动时按配置设置灯带长度、引脚和颜色顺序，像素缓冲区只在这里分配一次
+void applyStripConfig() {
+  int order = findColorOrder(ledColorOrder);
+  strip.clear();
+  strip.show();
+  strip.updateType(COLOR_ORDER_TYPES[order < 0 ? 0 : order] + NEO_KHZ800);
+  strip.updateLength(ledCount);
+  if (strip.numPixels() != ledCount) {
+    Serial.println(F("错误：灯带缓冲区分配失败，使用默认长度。"));
+    ledCount = DEFAULT_LED_COUNT;
+    strip.updateLength(ledCount);
+    if (strip.numPixels() != ledCount) {
+      // 连默认长度都分配不了时灯带长度为 0，updateLED 和测试灯都不再输出
+      Serial.println(F("错误：灯带缓冲区分配失败，灯效已停用。"));
+      return;
+    }
   }
+  strip.setPin(ledPin);
+  Serial.print(F("灯带已配置：")); Serial.print(ledCount);
+  Serial.print(F(" 颗，GPIO")); Serial.print(ledPin);
+  Serial.print(F("，颜色顺序 ")); Serial.println(ledColorOrder);
 }
 
+// 渲染函数（colorScale、ditherColor、renderProgress 等）在 v4.2_render.h 中，与主机基准测试共用
+TemporalDither edgeDither = {};    // 进度条末尾灯珠
+TemporalDither breathDither = {};  // 呼吸灯（待机与 AP 模式不会同时出现，共用一份）
+
 void updateLED() {
   unsigned long currentMillis = millis();
   if (currentMillis - lastLedUpdate < LED_UPDATE_INTERVAL || testingLed) {
     return;
   }
+  if (strip.numPixels() == 0) return;   // 灯带缓冲区分配失败，灯效已停用
   lastLedUpdate = currentMillis;
 
   strip.clear();
 
-  float currentBrightnessRatio = 1.0;
+  const int pixelCount = strip.numPixels();
   uint32_t currentBaseColor = strip.Color(0, 0, 0);
 
   State displayState = currentState;
   if (forcedMode == PROGRESS) displayState = PRINTING;
   else if (forcedMode == STANDBY) displayState = CONNECTED_PRINTER;
 
-  strip.setBrightness(constrain(globalBrightness * currentBrightnessRatio, 0, 255));
+  // 合成时不经过 setBrightness，全局亮度在最后统一折算；scaled 内的灯珠已按亮度抖动过
+  strip.setBrightness(255);
+  const uint8_t brightness = constrain(globalBrightness, 0, 255);
+  ScaledRange scaled = { 0, 0 };
 
   switch (displayState) {
     case AP_MODE:
       apClientConnected = WiFi.softAPgetStationNum() > 0;
       currentBaseColor = apClientConnected ? strip.Color(0, 255, 0) : strip.Color(0, 0, 255);
-      strip.setPixelColor(0, colorScale(currentBaseColor, (sin(currentMillis / 300.0 * PI) + 1) / 2.0));
-      currentBrightnessRatio = 1.0;
+      strip.setPixelColor(0, ditherColor(&breathDither, currentBaseColor, wave8(currentMillis, 600), brightness));
+      scaled.to = 1;
       break;
 
     case CONNECTING_WIFI:
     case CONNECTING_PRINTER:
       strip.setPixelColor(0, (currentMillis / 500) % 2 ? strip.Color(255, 0, 0) : strip.Color(0, 0, 255));
-      currentBrightnessRatio = 1.0;
       break;
 
     case CONNECTED_WIFI:
       strip.setPixelColor(0, strip.Color(0, 0, 255));
       strip.setPixelColor(1, (currentMillis / 500) % 2 ? strip.Color(255, 0, 0) : 0);
-      currentBrightnessRatio = 1.0;
       break;
 
     case PRINTING:
-      currentBrightnessRatio = progressBarBrightnessRatio;
-      currentBaseColor = progressBarColor;
-      {
-        float pixelsToLight = (float)printPercent * LED_COUNT / 100.0;
-        int fullPixels = (int)pixelsToLight;
-        float partialPixelBrightness = pixelsToLight - fullPixels;
-
-        fullPixels = constrain(fullPixels, 0, LED_COUNT);
-
-        for (int i = 0; i < fullPixels; i++) {
-          strip.setPixelColor(i, currentBaseColor);
-        }
-
-        if (fullPixels < LED_COUNT && partialPixelBrightness > 0.01) {
-          strip.setPixelColor(fullPixels, colorScale(currentBaseColor, partialPixelBrightness));
-        }
-
-        if (overlayMarquee) {
-          int currentMarqueePos = marqueePosition;
-          for (int i = 0; i < LED_COUNT; i++) {
-            if (i < fullPixels || (i == fullPixels && partialPixelBrightness > 0.01) || strip.getPixelColor(i) == 0) {
-              float rainbowPos = ((float)(i - currentMarqueePos + LED_COUNT * 2) / (LED_COUNT * 2.0));
-              rainbowPos -= (int)rainbowPos;
-              uint32_t rainbowColor = getRainbowColor(rainbowPos);
-              uint32_t existingColor = strip.getPixelColor(i);
-
-              uint8_t r1 = (existingColor >> 16) & 0xFF;
-              uint8_t g1 = (existingColor >> 8) & 0xFF;
-              uint8_t b1 = existingColor & 0xFF;
-              uint8_t r2 = (rainbowColor >> 16) & 0xFF;
-              uint8_t g2 = (rainbowColor >> 8) & 0xFF;
-              uint8_t b2 = rainbowColor & 0xFF;
-
-              float blendFactor = (existingColor == 0) ? 0.3 : 0.5;
-              strip.setPixelColor(i, strip.Color(
-                (uint8_t)(r1 * (1.0 - blendFactor) + r2 * blendFactor),
-                (uint8_t)(g1 * (1.0 - blendFactor) + g2 * blendFactor),
-                (uint8_t)(b1 * (1.0 - blendFactor) + b2 * blendFactor)
-              ));
-            }
-          }
-        }
-      }
+      renderProgress(strip, estimateProgressQ8(currentMillis), progressBarColor, overlayMarquee, marqueePosition,
+                     brightness, &edgeDither, scaled);
       break;
 
     case CONNECTED_PRINTER:
-      currentBrightnessRatio = standbyBrightnessRatio;
       if (strcmp(standbyMode, "marquee") == 0) {
-        int currentMarqueePos = marqueePosition;
-        for (int i = 0; i < LED_COUNT; i++) {
-          float pos = ((float)(i - currentMarqueePos + LED_COUNT * 2) / (LED_COUNT * 2.0));
-          pos -= (int)pos;
-          strip.setPixelColor(i, getRainbowColor(pos));
-        }
+        renderMarquee(strip, marqueePosition);
       } else if (strcmp(standbyMode, "breathing") == 0) {
-        currentBaseColor = standbyBreathingColor;
-        float breath = (sin(currentMillis / 1000.0 * PI) + 1.0) / 2.0;
-        uint32_t breathColor = colorScale(currentBaseColor, breath);
-        for (int i = 0; i < LED_COUNT; i++) {
-          strip.setPixelColor(i, breathColor);
-        }
+        renderBreathing(strip, standbyBreathingColor, wave8(currentMillis, 2000), brightness, &breathDither, scaled);
       }
       break;
 
     case ERROR:
       currentBaseColor = strip.Color(255, 0, 0);
       if ((currentMillis / 500) % 2) {
-        for (int i = 0; i < LED_COUNT; i++) {
+        for (int i = 0; i < pixelCount; i++) {
           strip.setPixelColor(i, currentBaseColor);
         }
       }
-      currentBrightnessRatio = 1.0;
       break;
 
     default:
       strip.setPixelColor(0, (currentMillis / 250) % 2 ? strip.Color(255, 0, 0) : strip.Color(0, 0, 255));
-      currentBrightnessRatio = 1.0;
       Serial.println(F("警告：updateLED 中遇到未知状态，使用默认闪烁模式。"));
       break;
   }
 
-  marqueePosition = (marqueePosition - 1) % (LED_COUNT * 2); // 反转流动方向，从递增改为递减
-  if (marqueePosition < 0) marqueePosition += LED_COUNT * 2; // 确保非负值
+  applyBrightness(strip, brightness, scaled);
+  marqueePosition = advanceMarquee(marqueePosition, pixelCount * 2);
   strip.show();
 }
 
@@ -1274,7 +1913,8 @@ void updateTestLed() {
   lastTestLedUpdate = currentMillis;
 
   strip.clear();
-  if (testLedIndex >= LED_COUNT) {
+  strip.setBrightness(constrain(globalBrightness, 0, 255));
+  if (testLedIndex >= (int)strip.numPixels()) {
     testingLed = false;
     testLedIndex = 0;
     Serial.println(F("LED 测试完成。"));
@@ -1310,7 +1950,13 @@ String getForcedModeText(ForcedMode mode) {
 }
 
 bool isConfigValid() {
-  return strlen(uid) > 0 && strlen(accessToken) > 0 && strlen(deviceID) > 0;
+  if (strlen(deviceID) == 0) return false;
+  if (isLanMode()) return strlen(accessCode) > 0;
+  return strlen(uid) > 0 && strlen(accessToken) > 0;
+}
+
+bool isLanMode() {
+  return strlen(printerIP) > 0;
 }
 
 bool isPrinting() {
@@ -1319,8 +1965,21 @@ bool isPrinting() {
 
 // --- Web 服务器处理函数 ---
 void handleRoot(AsyncWebServerRequest *request) {
+  // 浏览器缓存的页面仍是当前版本时直接回 304，不访问文件系统
+  if (indexEtag[0] != '\0' && request->hasHeader("If-None-Match") && request->header("If-None-Match") == indexEtag) {
+    AsyncWebServerResponse *response = request->beginResponse(304);
+    response->addHeader("ETag", indexEtag);
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+    return;
+  }
   if (LittleFS.exists("/index.html")) {
-    request->send(LittleFS, "/index.html", "text/html");
+    AsyncWebServerResponse *response = request->beginResponse(LittleFS, "/index.html", "text/html");
+    if (indexEtag[0] != '\0') {
+      response->addHeader("ETag", indexEtag);
+      response->addHeader("Cache-Control", "no-cache");
+    }
+    request->send(response);
   } else {
     request->send(500, "text/plain", "服务器错误：未找到 /index.html。");
   }
@@ -1335,6 +1994,10 @@ void handleConfig(AsyncWebServerRequest *request) {
   String newUid = request->hasParam("uid", true) ? request->getParam("uid", true)->value() : "";
   String newAccessToken = request->hasParam("accessToken", true) ? request->getParam("accessToken", true)->value() : "";
   String newDeviceID = request->hasParam("deviceID", true) ? request->getParam("deviceID", true)->value() : "";
+  String newPrinterIP = request->hasParam("printerIP", true) ? request->getParam("printerIP", true)->value() : "";
+  String newAccessCode = request->hasParam("accessCode", true) ? request->getParam("accessCode", true)->value() : "";
+  newPrinterIP.trim();
+  bool newLanMode = newPrinterIP.length() > 0;
   int newBrightness = request->hasParam("brightness", true) ? request->getParam("brightness", true)->value().toInt() : globalBrightness;
   String newStandbyMode = request->hasParam("standbyMode", true) ? request->getParam("standbyMode", true)->value() : "marquee";
   bool newOverlayMarquee = request->hasParam("overlayMarquee", true);
@@ -1343,9 +2006,15 @@ void handleConfig(AsyncWebServerRequest *request) {
   float newProgressBarBrightnessRatio = request->hasParam("progressBarBrightnessRatio", true) ? request->getParam("progressBarBrightnessRatio", true)->value().toFloat() : 1.0;
   float newStandbyBrightnessRatio = request->hasParam("standbyBrightnessRatio", true) ? request->getParam("standbyBrightnessRatio", true)->value().toFloat() : 1.0;
   unsigned long newCustomPushallInterval = request->hasParam("customPushallInterval", true) ? request->getParam("customPushallInterval", true)->value().toInt() : 30;
+  int newLedCount = request->hasParam("ledCount", true) ? request->getParam("ledCount", true)->value().toInt() : ledCount;
+  int newLedPin = request->hasParam("ledPin", true) ? request->getParam("ledPin", true)->value().toInt() : ledPin;
+  String newLedColorOrder = request->hasParam("ledColorOrder", true) ? request->getParam("ledColorOrder", true)->value() : String(ledColorOrder);
 
-  if (newUid.length() > 0 && newUid.length() < sizeof(uid) &&
-      newAccessToken.length() > 0 && newAccessToken.length() < sizeof(accessToken) &&
+  bool credentialsValid = newLanMode
+      ? (newPrinterIP.length() < sizeof(printerIP) && newAccessCode.length() > 0 && newAccessCode.length() < sizeof(accessCode))
+      : (newUid.length() > 0 && newAccessToken.length() > 0);
+
+  if (credentialsValid && newUid.length() < sizeof(uid) && newAccessToken.length() < sizeof(accessToken) &&
       newDeviceID.length() > 0 && newDeviceID.length() < sizeof(deviceID) &&
       newBrightness >= 0 && newBrightness <= 255 &&
       (newStandbyMode == "marquee" || newStandbyMode == "breathing") &&
@@ -1353,7 +2022,9 @@ void handleConfig(AsyncWebServerRequest *request) {
       standbyBreathingColorHex.length() == 7 && standbyBreathingColorHex.startsWith("#") &&
       newProgressBarBrightnessRatio >= 0.0 && newProgressBarBrightnessRatio <= 1.0 &&
       newStandbyBrightnessRatio >= 0.0 && newStandbyBrightnessRatio <= 1.0 &&
-      newCustomPushallInterval >= 10 && newCustomPushallInterval <= 600) {
+      newCustomPushallInterval >= 10 && newCustomPushallInterval <= 600 &&
+      newLedCount >= 1 && newLedCount <= MAX_LED_COUNT && newLedPin >= 0 && newLedPin <= 21 &&
+      findColorOrder(newLedColorOrder.c_str()) >= 0) {
 
     strncpy(uid, newUid.c_str(), sizeof(uid) - 1);
     uid[sizeof(uid) - 1] = '\0';
@@ -1361,6 +2032,10 @@ void handleConfig(AsyncWebServerRequest *request) {
     accessToken[sizeof(accessToken) - 1] = '\0';
     strncpy(deviceID, newDeviceID.c_str(), sizeof(deviceID) - 1);
     deviceID[sizeof(deviceID) - 1] = '\0';
+    strncpy(printerIP, newPrinterIP.c_str(), sizeof(printerIP) - 1);
+    printerIP[sizeof(printerIP) - 1] = '\0';
+    strncpy(accessCode, newAccessCode.c_str(), sizeof(accessCode) - 1);
+    accessCode[sizeof(accessCode) - 1] = '\0';
     globalBrightness = newBrightness;
     strncpy(standbyMode, newStandbyMode.c_str(), sizeof(standbyMode) - 1);
     standbyMode[sizeof(standbyMode) - 1] = '\0';
@@ -1374,6 +2049,11 @@ void handleConfig(AsyncWebServerRequest *request) {
     progressBarBrightnessRatio = newProgressBarBrightnessRatio;
     standbyBrightnessRatio = newStandbyBrightnessRatio;
     customPushallInterval = newCustomPushallInterval;
+    // 灯带参数只写入配置，重启后才会按新长度重新分配像素缓冲区
+    ledCount = newLedCount;
+    ledPin = newLedPin;
+    strncpy(ledColorOrder, newLedColorOrder.c_str(), sizeof(ledColorOrder) - 1);
+    ledColorOrder[sizeof(ledColorOrder) - 1] = '\0';
 
     strip.setBrightness(globalBrightness);
     saveConfig();
@@ -1381,10 +2061,7 @@ void handleConfig(AsyncWebServerRequest *request) {
 
     if (isConfigValid() && WiFi.status() == WL_CONNECTED) {
       mqttClient.disconnect();
-      espClient.setInsecure();
-      mqttClient.setServer(MQTT_SERVER, MQTT_PORT);
-      mqttClient.setCallback(mqttCallback);
-      mqttClient.setBufferSize(512);
+      configureMqttServer();
       reconnectMQTT();
     }
 
@@ -1413,30 +2090,52 @@ void handleLog(AsyncWebServerRequest *request) {
   request->send(200, "text/plain", log);
 }
 
-void handleStatus(AsyncWebServerRequest *request) {
+void buildStatusJson(String &output) {
   DynamicJsonDocument doc(512);
   doc["status"] = (int)currentState;
   doc["status_text"] = getStateText(currentState);
   doc["forced_mode"] = getForcedModeText(forcedMode);
   doc["print_percent"] = printPercent;
+  doc["print_percent_estimate"] = progressEstimator.lastQ8 / 256.0;
   doc["gcode_state"] = gcodeState;
   doc["remaining_time"] = remainingTime;
   doc["layer_num"] = layerNum;
   doc["heap_free"] = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+  serializeJson(doc, output);
+}
 
+void handleStatus(AsyncWebServerRequest *request) {
   String output;
-  serializeJson(doc, output);
+  buildStatusJson(output);
   request->send(200, "application/json", output);
 }
 
+// 状态、强制模式或打印进度变化时向 /events 订阅者推送完整状态；进度估算和堆内存每帧都在变，不作为推送条件
+void pushStatusEvent() {
+  if (currentState == pushedState && forcedMode == pushedForcedMode && gcodeState == pushedGcodeState &&
+      printPercent == pushedPrintPercent && remainingTime == pushedRemainingTime && layerNum == pushedLayerNum) {
+    return;
+  }
+  pushedState = currentState;
+  pushedForcedMode = forcedMode;
+  pushedGcodeState = gcodeState;
+  pushedPrintPercent = printPercent;
+  pushedRemainingTime = remainingTime;
+  pushedLayerNum = layerNum;
+  statusEventId++;
+  if (events.count() == 0) return;
+  String output;
+  buildStatusJson(output);
+  events.send(output.c_str(), "status", statusEventId);
+}
+
 void handleClearCache(AsyncWebServerRequest *request) {
   if (request->method() != HTTP_POST) {
     request->send(405, "text/plain", "方法不支持");
     return;
   }
-  if (LittleFS.exists(MQTT_RX_BUFFER_FILE)) LittleFS.remove(MQTT_RX_BUFFER_FILE);
-  if (LittleFS.exists(MQTT_TX_BUFFER_FILE)) LittleFS.remove(MQTT_TX_BUFFER_FILE);
-  Serial.println(F("已清除 MQTT 缓冲缓存。"));
+  clearMqttBuffersRequested = true;
+  Serial.println(F("已请求清除 MQTT 缓冲缓存。"));
   request->send(200, "text/plain", "缓存清除成功。");
 }
 
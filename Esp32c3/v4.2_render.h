@@ -0,0 +1,179 @@
+#ifndef V4_2_RENDER_H
+#define V4_2_RENDER_H
+// v4.2 的灯效渲染核心，与 v4.2.cpp 放在同一目录。固件和主机上的基准测试
+// （v5.0/c3-main/test/native/v42_bench.cpp）包含的是同一份代码。
+// 这里只做像素运算：灯带类型是模板参数，时间、进度和亮度都由调用方传入。
+// ESP32-C3 没有 FPU，渲染路径全部使用定点数：亮度/混合比例为 Q8（0-255 表示 0-1）
+#include <Arduino.h>
+#include <pgmspace.h>
+
+// 编译期生成的查找表，定义在 v4.2.cpp（主机上由 v5 的 lut.cpp 提供）
+extern const uint32_t RAINBOW_LUT[256];
+extern const uint8_t GAMMA_LUT[256];
+extern const uint8_t QUARTER_SINE_LUT[65];
+
+inline uint32_t packColor(uint8_t r, uint8_t g, uint8_t b) {
+  return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+}
+
+// 按 Q8 比例缩放颜色，比例先经过 gamma 校正，255 保持原色
+inline uint32_t colorScale(uint32_t color, uint8_t scale) {
+  uint16_t s = pgm_read_byte(&GAMMA_LUT[scale]) + 1;
+  uint8_t r = (((color >> 16) & 0xFF) * s) >> 8;
+  uint8_t g = (((color >> 8) & 0xFF) * s) >> 8;
+  uint8_t b = ((color & 0xFF) * s) >> 8;
+  return packColor(r, g, b);
+}
+
+// 按 Q8 权重从 from 混合到 to
+inline uint32_t colorBlend(uint32_t from, uint32_t to, uint8_t weight) {
+  uint16_t w = weight;
+  uint16_t inv = 256 - w;
+  uint8_t r = ((((from >> 16) & 0xFF) * inv) + (((to >> 16) & 0xFF) * w)) >> 8;
+  uint8_t g = ((((from >> 8) & 0xFF) * inv) + (((to >> 8) & 0xFF) * w)) >> 8;
+  uint8_t b = (((from & 0xFF) * inv) + ((to & 0xFF) * w)) >> 8;
+  return packColor(r, g, b);
+}
+
+// 由四分之一周期表还原完整正弦，phase 0-255 对应一个周期，输出 1-255
+inline uint8_t lutSine8(uint8_t phase) {
+  uint8_t idx = phase & 63;
+  uint8_t q = (phase & 64) ? pgm_read_byte(&QUARTER_SINE_LUT[64 - idx]) : pgm_read_byte(&QUARTER_SINE_LUT[idx]);
+  return (phase & 128) ? 128 - q : 128 + q;
+}
+
+// 周期为 periodMs 的正弦波，相位 0 时为 128（等价于 (sin + 1) / 2）
+inline uint8_t wave8(unsigned long ms, unsigned long periodMs) {
+  uint8_t phase = (uint8_t)(((ms % periodMs) << 8) / periodMs);
+  return lutSine8(phase);
+}
+
+// hue 为色环位置（0-255），颜色已做过 gamma 校正
+inline uint32_t getRainbowColor(uint8_t hue) {
+  return pgm_read_dword(&RAINBOW_LUT[hue]);
+}
+
+// 时间抖动：低亮度下一个量化步长内的差别会被截断，把每帧的小数部分累积起来，
+// 满一步时这一帧多输出 1，多帧平均后得到目标亮度。每个抖动对象对应一组颜色相同的灯珠
+struct TemporalDither {
+  uint8_t residue[3];
+};
+
+// 输出 color × gamma(scale) × brightness，三者乘积保留 Q16 精度；
+// d 不为空时小数部分按帧扩散，为空时直接截断（不抖动）
+inline uint32_t ditherColor(TemporalDither *d, uint32_t color, uint8_t scale, uint8_t brightness) {
+  uint32_t k = (uint32_t)(pgm_read_byte(&GAMMA_LUT[scale]) + 1) * (brightness + 1);
+  uint8_t out[3];
+  for (int c = 0; c < 3; c++) {
+    uint32_t v = ((color >> (16 - 8 * c)) & 0xFF) * k;
+    if (d) {
+      uint16_t acc = d->residue[c] + ((v >> 8) & 0xFF);
+      out[c] = (v >> 16) + (acc >> 8);
+      d->residue[c] = acc & 0xFF;
+    } else {
+      out[c] = v >> 16;
+    }
+  }
+  return packColor(out[0], out[1], out[2]);
+}
+
+// 一帧中已经折算过全局亮度的灯珠区间 [from, to)，applyBrightness 时跳过
+struct ScaledRange {
+  int from;
+  int to;
+};
+
+// 跑马灯色环：marqueePosition 处为色环起点，两倍灯带长度走完一圈
+inline uint8_t marqueeHue(int i, int marqueePosition, int marqueeSpan) {
+  return ((i - marqueePosition + marqueeSpan) % marqueeSpan) * 255 / marqueeSpan;
+}
+
+// 进度条：progressQ8 为 Q8 百分比（25600 表示 100%），末尾灯珠按小数部分调暗，可叠加跑马灯
+template <typename Strip>
+void renderProgress(Strip &strip, uint32_t progressQ8, uint32_t color, bool overlayMarquee, int marqueePosition,
+                    uint8_t brightness, TemporalDither *edgeDither, ScaledRange &scaled) {
+  const int pixelCount = strip.numPixels();
+  const int marqueeSpan = pixelCount * 2;
+  // 点亮的灯珠数用 Q8 表示：高位为整颗灯珠，低 8 位为末尾灯珠的亮度
+  uint32_t litQ8 = progressQ8 * pixelCount / 100;
+  int fullPixels = litQ8 >> 8;
+  uint8_t partialPixelBrightness = litQ8 & 0xFF;
+
+  fullPixels = constrain(fullPixels, 0, pixelCount);
+
+  for (int i = 0; i < fullPixels; i++) {
+    strip.setPixelColor(i, color);
+  }
+
+  // 小于约 1% 的末尾亮度不显示
+  bool hasPartialPixel = fullPixels < pixelCount && partialPixelBrightness > 2;
+  if (hasPartialPixel && !overlayMarquee) {
+    strip.setPixelColor(fullPixels, ditherColor(edgeDither, color, partialPixelBrightness, brightness));
+    scaled.from = fullPixels;
+    scaled.to = fullPixels + 1;
+  } else if (hasPartialPixel) {
+    // 叠加跑马灯时末尾灯珠还要参与混合，仍按普通方式缩放
+    strip.setPixelColor(fullPixels, colorScale(color, partialPixelBrightness));
+  }
+
+  if (overlayMarquee) {
+    for (int i = 0; i < pixelCount; i++) {
+      uint32_t existingColor = strip.getPixelColor(i);
+      if (i < fullPixels || (i == fullPixels && hasPartialPixel) || existingColor == 0) {
+        // 未点亮的灯珠叠加 30%，已点亮的叠加 50%
+        uint8_t blendFactor = (existingColor == 0) ? 77 : 128;
+        strip.setPixelColor(i, colorBlend(existingColor, getRainbowColor(marqueeHue(i, marqueePosition, marqueeSpan)), blendFactor));
+      }
+    }
+  }
+}
+
+// 待机跑马灯：整条灯带铺满色环
+template <typename Strip>
+void renderMarquee(Strip &strip, int marqueePosition) {
+  const int pixelCount = strip.numPixels();
+  const int marqueeSpan = pixelCount * 2;
+  for (int i = 0; i < pixelCount; i++) {
+    strip.setPixelColor(i, getRainbowColor(marqueeHue(i, marqueePosition, marqueeSpan)));
+  }
+}
+
+// 呼吸灯：所有灯珠颜色相同，只算一次并直接按全局亮度折算，填充后不再逐颗缩放
+template <typename Strip>
+void renderBreathing(Strip &strip, uint32_t color, uint8_t level, uint8_t brightness, TemporalDither *dither,
+                     ScaledRange &scaled) {
+  const int pixelCount = strip.numPixels();
+  uint32_t breathColor = ditherColor(dither, color, level, brightness);
+  for (int i = 0; i < pixelCount; i++) {
+    strip.setPixelColor(i, breathColor);
+  }
+  scaled.from = 0;
+  scaled.to = pixelCount;
+}
+
+// 其余灯珠按全局亮度缩放，截断方式与 setBrightness 相同
+template <typename Strip>
+void applyBrightness(Strip &strip, uint8_t brightness, const ScaledRange &scaled) {
+  const int pixelCount = strip.numPixels();
+  const uint16_t brightnessScale = brightness + 1;
+  for (int i = 0; i < pixelCount; i++) {
+    if (i == scaled.from && scaled.to > scaled.from) {
+      i = scaled.to - 1;
+      continue;
+    }
+    uint32_t color = strip.getPixelColor(i);
+    if (color == 0) continue;
+    strip.setPixelColor(i, (((color >> 16) & 0xFF) * brightnessScale) >> 8,
+                           (((color >> 8) & 0xFF) * brightnessScale) >> 8,
+                           ((color & 0xFF) * brightnessScale) >> 8);
+  }
+}
+
+// 跑马灯每帧后退一格（从右向左流动），结果保持非负
+inline int advanceMarquee(int marqueePosition, int marqueeSpan) {
+  marqueePosition = (marqueePosition - 1) % marqueeSpan;
+  if (marqueePosition < 0) marqueePosition += marqueeSpan;
+  return marqueePosition;
+}
+
+#endif
@@ -0,0 +1,22 @@
+# 构建前把 web/ 下的页面压缩到 data/，文件系统镜像里只放 .gz，由 web.cpp 以 gzip 编码直接发送
+# mtime 固定为 0，内容不变时输出字节也不变
+Import("env")
+
+import gzip
+import os
+
+project_dir = env.subst("$PROJECT_DIR")
+src_dir = os.path.join(project_dir, "web")
+data_dir = os.path.join(project_dir, "data")
+
+for name in os.listdir(src_dir):
+    src = os.path.join(src_dir, name)
+    dst = os.path.join(data_dir, name + ".gz")
+    if os.path.exists(dst) and os.path.getmtime(dst) >= os.path.getmtime(src):
+        continue
+    with open(src, "rb") as f:
+        raw = f.read()
+    with open(dst, "wb") as f:
+        with gzip.GzipFile(filename=name, mode="wb", fileobj=f, compresslevel=9, mtime=0) as gz:
+            gz.write(raw)
+    print("gzip_web: %s -> %s (%d -> %d bytes)" % (name, os.path.relpath(dst, project_dir), len(raw), os.path.getsize(dst)))
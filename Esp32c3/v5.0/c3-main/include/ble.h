@@ -6,7 +6,7 @@
 void setupBLE();
 void updateBLE();
 void handleBLECommand(const String& cmd);
-String getBLEStatusResponse();
+size_t writeBLEStatusResponse(char* out, size_t size);
 String getBLEConfigResponse();
 String getBLELogResponse();
 void hardReset();
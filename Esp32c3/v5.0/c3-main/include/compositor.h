@@ -0,0 +1,109 @@
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+#include "config.h"
+#include "pixel_sink.h"
+
+// 灯效合成：只依赖快照、时间和输出端，不碰 FreeRTOS、灯带和全局配置，可以在主机上回放测试
+
+enum State {
+    AP_MODE, CONNECTING_WIFI, CONNECTED_WIFI, CONNECTING_PRINTER,
+    CONNECTED_PRINTER, PRINTING, FAILED
+};
+enum ForcedMode {
+    NONE, PROGRESS, STANDBY, AP_MODE_F, CONNECTING_WIFI_F, CONNECTED_WIFI_F,
+    CONNECTING_PRINTER_F, CONNECTED_PRINTER_F, PRINTING_F, FAILED_F
+};
+
+// 灯效关心的打印阶段，由 gcode_state 归类
+enum PrinterPhase : uint8_t { PHASE_IDLE, PHASE_PRINTING, PHASE_FAILED };
+
+// 进度来源，发布快照时由配置字符串解析一次
+enum ProgressSource : uint8_t { PS_AUTO, PS_PERCENT, PS_LAYERS, PS_TIME };
+
+// 合成一帧所需的全部输入：打印机状态、灯效配置和状态机，渲染路径不读其他全局变量
+struct LedSnapshot {
+    int16_t printPercent[MAX_PRINTERS];
+    int16_t layerNum[MAX_PRINTERS];
+    int16_t totalLayerNum[MAX_PRINTERS];
+    int32_t remainingTime[MAX_PRINTERS];
+    uint32_t anchorMs[MAX_PRINTERS];   // 上述字段最近一次变化的时刻，按时间推算进度的起点
+    bool running[MAX_PRINTERS];
+    PrinterPhase phase[MAX_PRINTERS];  // 每个分段按打印阶段选场景
+    PrinterSegment segments[MAX_PRINTERS];
+    uint8_t segmentCount;
+    State state;
+    ForcedMode forcedMode;
+    uint32_t progressBarColor;
+    uint32_t standbyColor;
+    uint8_t globalBrightness;
+    uint8_t progressBrightness;        // 已乘上比例的亮度，渲染时不再做浮点运算
+    uint8_t standbyBrightness;
+    ProgressSource progressSource;
+    bool standbyBreathing;
+    bool overlayMarquee;
+};
+
+PrinterPhase gcodePhase(const char* gcodeState);
+ProgressSource parseProgressSource(const char* source);
+
+struct LayerSpec;
+
+// 帧合成器：持有前后台帧缓冲和跨帧状态（进度单调、跑马灯位置、测试灯珠），
+// 每次 render 合成一帧，与上一帧不同时才交给输出端
+class Compositor {
+public:
+    static constexpr uint32_t PROGRESS_FULL_Q8 = 100UL << 8;   // 进度统一用 Q8 百分比表示
+
+    ~Compositor();
+    // 按灯带长度一次性分配缓冲区，之后不再申请内存；失败时长度为 0，render 不做任何事
+    bool begin(uint16_t length);
+    uint16_t length() const { return stripLength; }
+    // 替换输出端；切换后下一帧一定会输出
+    void setSink(PixelSink* sink);
+    // 从第一颗开始逐颗点亮测试，走完一圈后回到正常画面
+    void startTest();
+    // 按给定时间合成一帧，画面有变化时输出；返回是否调用了输出端
+    bool render(const LedSnapshot& snap, unsigned long now);
+
+    bool animated() const { return animatedFrame; }   // 最近一帧是否随时间变化，决定帧率
+    bool testing() const { return testingLed; }
+    int testIndex() const { return testLedIndex; }
+    uint8_t brightness() const { return frameBrightness; }
+    uint32_t framesShown() const { return shownCount; }
+    uint32_t framesSkipped() const { return skippedCount; }
+    uint32_t shownProgressQ8(uint8_t slot) const { return shownProgress[slot]; }
+
+private:
+    // 按同一场景绘制的一段灯带：连上打印机之前是整条灯带，之后每台打印机各占自己的分段
+    struct Region {
+        uint16_t start;
+        uint16_t length;
+        uint8_t slot;    // 对应的打印机快照下标
+        uint8_t scene;
+    };
+
+    void buildRegions(const LedSnapshot& snap);
+    void blendRange(int start, int length, uint32_t color, uint8_t alpha);
+    void renderLayer(const LayerSpec& layer, const Region& region, const LedSnapshot& snap, unsigned long now);
+    void renderProgress(const Region& region, uint32_t q8, uint32_t color, uint8_t alpha);
+    uint32_t progressQ8(const LedSnapshot& snap, uint8_t s, unsigned long now);
+    bool present();
+
+    uint16_t stripLength = 0;
+    uint32_t* frame = nullptr;       // 后台缓冲：正在合成的帧，0xRRGGBB
+    uint32_t* lastFrame = nullptr;   // 前台缓冲：上一帧已输出的像素
+    bool lastFrameValid = false;
+    PixelSink* sink = nullptr;
+    Region regions[MAX_PRINTERS];
+    uint8_t regionCount = 0;
+    uint32_t shownProgress[MAX_PRINTERS] = {};   // 每段上次显示的进度，保证单调不减
+    uint32_t marqueeStep = 0;                     // 跑马灯已走的帧数，各区域按自己的长度取模
+    bool testingLed = false;
+    int testLedIndex = 0;
+    bool animatedFrame = false;
+    uint8_t frameBrightness = 0;
+    uint32_t shownCount = 0;
+    uint32_t skippedCount = 0;
+};
+
+#endif
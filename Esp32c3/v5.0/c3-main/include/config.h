@@ -2,30 +2,42 @@
 #define CONFIG_H
 #include <Arduino.h>
 
+#define MAX_PRINTERS 8
+
+// 一台打印机对应灯带上的一段
+struct PrinterSegment {
+    char deviceID[32];
+    uint16_t start;
+    uint16_t length;
+};
+
 extern char uid[64];
 extern char accessToken[64];
 extern char deviceID[32];
+extern char mqttMode[8];
+extern char printerHost[64];
+extern char accessCode[16];
+extern int mqttPort;
+extern bool mqttTls;
 extern int customPushallInterval;
 extern uint32_t progressBarColor;
 extern uint32_t standbyBreathingColor;
 extern float progressBarBrightnessRatio;
 extern float standbyBrightnessRatio;
 extern char standbyMode[16];
+extern char progressSource[8];
 extern bool overlayMarquee;
 extern uint8_t globalBrightness;
+extern uint16_t ledCount;
+extern uint8_t ledPin;
+extern char ledColorOrder[4];
+extern char printerSegments[256];
+extern PrinterSegment segments[MAX_PRINTERS];
+extern uint8_t segmentCount;
 
-// Printer state variables
-extern int printPercent;
-extern String gcodeState;
-extern int remainingTime;
-extern int layerNum;
-extern int totalLayerNum;
-extern float nozzleTemper;
-extern float bedTemper;
-extern float chamberTemper;
-extern String wifiSignal;
-extern int spdLvl;
-
+bool isLanMode();
+bool isMqttConfigured();
+void parsePrinterSegments();
 void loadConfig();
 void saveConfig();
 
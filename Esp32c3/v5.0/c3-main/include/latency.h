@@ -0,0 +1,20 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// 报告到灯带刷新的各阶段耗时（微秒）
+enum LatencyStage : uint8_t {
+    LS_PARSE,   // mqttCallback 收到报告 -> 快照更新完成
+    LS_RENDER,  // 快照更新完成 -> strip.show() 返回
+    LS_TOTAL,   // mqttCallback 收到报告 -> strip.show() 返回
+    LS_COUNT
+};
+
+void latencyReportArrived(uint32_t at);
+void latencyReportMerged(bool changed);
+void latencyFrameShown();
+uint32_t latencySampleCount();
+void fillLatencyStats(JsonObject out);
+
+#endif
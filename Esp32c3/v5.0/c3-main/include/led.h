@@ -1,25 +1,27 @@
 #ifndef LED_H
 #define LED_H
 #include <Arduino.h>
-#define LED_COUNT 60
-#define LED_PIN 8
-enum State {
-    AP_MODE, CONNECTING_WIFI, CONNECTED_WIFI, CONNECTING_PRINTER,
-    CONNECTED_PRINTER, PRINTING, FAILED
-};
-enum ForcedMode {
-    NONE, PROGRESS, STANDBY, AP_MODE_F, CONNECTING_WIFI_F, CONNECTED_WIFI_F,
-    CONNECTING_PRINTER_F, CONNECTED_PRINTER_F, PRINTING_F, FAILED_F
-};
+#include <ArduinoJson.h>
+#include "compositor.h"
+// 灯带长度、引脚和颜色顺序在启动时从配置读取，这里只是默认值
+#define DEFAULT_LED_COUNT 60
+#define DEFAULT_LED_PIN 8
+#define MAX_LED_COUNT 1024
 void setupLED();
 void updateLED();
+void startLedTask();
+void publishLedSnapshot();
+void renderLedFrame(unsigned long now);
+void requestLedFrame();
+void ledConfigChanged();
+void startLedTest();
+void setPixelSink(PixelSink* sink);
 String getLedStatus();
+void fillLedStatus(JsonObject out);
 void setState(State state);
 State getState();
 void setForcedMode(ForcedMode mode);
 ForcedMode getForcedMode();
 String getStateText(State state);
 String getForcedModeText(ForcedMode mode);
-extern bool testingLed;
-extern int testLedIndex;
 #endif
\ No newline at end of file
@@ -0,0 +1,27 @@
+#ifndef LUT_H
+#define LUT_H
+#include <Arduino.h>
+#include <pgmspace.h>
+
+// 编译期生成的查找表，存放在 flash 中，所有灯效共用
+extern const uint32_t RAINBOW_LUT[256];     // HSV 色环，已做 gamma 校正，0xRRGGBB
+extern const uint8_t GAMMA_LUT[256];        // gamma 2.2 校正
+extern const uint8_t QUARTER_SINE_LUT[65];  // 四分之一周期正弦，幅度 0-127
+
+// hue 为色环位置（0-255）
+inline uint32_t lutRainbow8(uint8_t hue) {
+    return pgm_read_dword(&RAINBOW_LUT[hue]);
+}
+
+inline uint8_t lutGamma8(uint8_t value) {
+    return pgm_read_byte(&GAMMA_LUT[value]);
+}
+
+// 由四分之一周期表还原完整正弦，phase 0-255 对应一个周期，输出 1-255
+inline uint8_t lutSine8(uint8_t phase) {
+    uint8_t idx = phase & 63;
+    uint8_t q = (phase & 64) ? pgm_read_byte(&QUARTER_SINE_LUT[64 - idx]) : pgm_read_byte(&QUARTER_SINE_LUT[idx]);
+    return (phase & 128) ? 128 - q : 128 + q;
+}
+
+#endif
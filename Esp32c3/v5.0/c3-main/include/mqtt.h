@@ -6,9 +6,9 @@
 
 void setupMQTT();
 void updateMQTT();
+void mqttConfigChanged();
 void sendPushall();
-void processMqttMessage(const char *payload, unsigned int length);
+void processMqttMessage(const char *payload, unsigned int length, uint8_t slot = 0);
 extern PubSubClient client;
-extern JsonDocument printerState;
 
 #endif
\ No newline at end of file
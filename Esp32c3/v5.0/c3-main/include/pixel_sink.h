@@ -0,0 +1,13 @@
+#ifndef PIXEL_SINK_H
+#define PIXEL_SINK_H
+#include <stdint.h>
+
+// 渲染结果的输出端：渲染只产出亮度已折算的 0xRRGGBB 帧，由输出端决定写到灯带还是记录下来
+class PixelSink {
+public:
+    virtual ~PixelSink() {}
+    // 输出一帧；画面与上一帧相同时不会被调用
+    virtual void writeFrame(const uint32_t* pixels, uint16_t count) = 0;
+};
+
+#endif
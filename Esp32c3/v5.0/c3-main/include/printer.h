@@ -0,0 +1,54 @@
+#ifndef PRINTER_H
+#define PRINTER_H
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "config.h"
+
+// 打印机状态字段位，用于标记最近一次增量报告中变化的字段
+enum PrinterField : uint16_t {
+    PF_GCODE_STATE     = 1 << 0,
+    PF_PRINT_PERCENT   = 1 << 1,
+    PF_REMAINING_TIME  = 1 << 2,
+    PF_LAYER_NUM       = 1 << 3,
+    PF_TOTAL_LAYER_NUM = 1 << 4,
+    PF_NOZZLE_TEMPER   = 1 << 5,
+    PF_BED_TEMPER      = 1 << 6,
+    PF_CHAMBER_TEMPER  = 1 << 7,
+    PF_WIFI_SIGNAL     = 1 << 8,
+    PF_SPD_LVL         = 1 << 9,
+    PF_ALL             = 0x03FF
+};
+
+// 状态消费者，各自独立累积未处理的变化位
+enum PrinterConsumer : uint8_t {
+    PC_LED, PC_WEB, PC_BLE, PC_COUNT
+};
+
+// 固定结构的打印机状态快照
+struct PrinterSnapshot {
+    char gcodeState[16];
+    char wifiSignal[12];
+    int16_t printPercent;
+    int16_t layerNum;
+    int16_t totalLayerNum;
+    uint8_t spdLvl;
+    int32_t remainingTime;
+    float nozzleTemper;
+    float bedTemper;
+    float chamberTemper;
+    uint16_t changed;   // 最近一次报告中变化的字段
+    uint32_t version;   // 每次有字段变化时递增
+};
+
+// 每个分段一份快照，下标与 segments 一致；printer 指向主打印机（第一个分段）
+extern PrinterSnapshot printers[MAX_PRINTERS];
+extern PrinterSnapshot& printer;
+
+void resetPrinters();
+uint16_t scanReportFields(const char* payload, size_t length);
+uint16_t mergePrinterReport(uint8_t slot, JsonObjectConst print);
+uint16_t takePrinterChanges(PrinterConsumer consumer, uint16_t interest);
+uint16_t takePrinterSlotChanges(PrinterConsumer consumer, uint8_t slot, uint16_t interest);
+void fillPrinterStatus(JsonObject out);
+
+#endif
@@ -2,5 +2,6 @@
 #define WEB_H
 
 void setupWebServer();
+void refreshStatusCache();
 
 #endif
\ No newline at end of file
@@ -3,6 +3,8 @@
 #include "utils.h"
 #include "mqtt.h"
 #include "led.h"
+#include "printer.h"
+#include "latency.h"
 #include <NimBLEDevice.h>
 #include <ArduinoJson.h>
 
@@ -75,8 +77,9 @@ void handleBLECommand(const String& command) {
 
     String action = doc["action"].as<const char*>();
     if (action == "get_status") {
-        String response = getBLEStatusResponse();
-        pCharacteristic->setValue(response.c_str());
+        static char response[768];
+        size_t length = writeBLEStatusResponse(response, sizeof(response));
+        pCharacteristic->setValue(reinterpret_cast<const uint8_t*>(response), length);
         pCharacteristic->notify();
         appendLog("BLE 发送状态响应");
     } else if (action == "get_config") {
@@ -88,15 +91,28 @@ void handleBLECommand(const String& command) {
         if (!doc["uid"].isNull()) strlcpy(uid, doc["uid"].as<const char*>(), sizeof(uid));
         if (!doc["accessToken"].isNull()) strlcpy(accessToken, doc["accessToken"].as<const char*>(), sizeof(accessToken));
         if (!doc["deviceID"].isNull()) strlcpy(deviceID, doc["deviceID"].as<const char*>(), sizeof(deviceID));
+        if (!doc["mqttMode"].isNull()) strlcpy(mqttMode, doc["mqttMode"].as<const char*>(), sizeof(mqttMode));
+        if (!doc["printerHost"].isNull()) strlcpy(printerHost, doc["printerHost"].as<const char*>(), sizeof(printerHost));
+        if (!doc["accessCode"].isNull()) strlcpy(accessCode, doc["accessCode"].as<const char*>(), sizeof(accessCode));
+        if (!doc["mqttPort"].isNull()) mqttPort = doc["mqttPort"].as<int>();
+        if (!doc["mqttTls"].isNull()) mqttTls = doc["mqttTls"].as<bool>();
         if (!doc["customPushallInterval"].isNull()) customPushallInterval = doc["customPushallInterval"].as<int>();
         if (!doc["progressBarColor"].isNull()) progressBarColor = doc["progressBarColor"].as<uint32_t>();
         if (!doc["standbyBreathingColor"].isNull()) standbyBreathingColor = doc["standbyBreathingColor"].as<uint32_t>();
         if (!doc["progressBarBrightnessRatio"].isNull()) progressBarBrightnessRatio = doc["progressBarBrightnessRatio"].as<float>();
         if (!doc["standbyBrightnessRatio"].isNull()) standbyBrightnessRatio = doc["standbyBrightnessRatio"].as<float>();
         if (!doc["standbyMode"].isNull()) strlcpy(standbyMode, doc["standbyMode"].as<const char*>(), sizeof(standbyMode));
+        if (!doc["progressSource"].isNull()) strlcpy(progressSource, doc["progressSource"].as<const char*>(), sizeof(progressSource));
         if (!doc["overlayMarquee"].isNull()) overlayMarquee = doc["overlayMarquee"].as<bool>();
         if (!doc["globalBrightness"].isNull()) globalBrightness = doc["globalBrightness"].as<uint8_t>();
+        // 灯带参数只写入配置，重启后才会按新长度分配缓冲区
+        if (!doc["ledCount"].isNull()) ledCount = constrain(doc["ledCount"].as<int>(), 1, MAX_LED_COUNT);
+        if (!doc["ledPin"].isNull()) ledPin = constrain(doc["ledPin"].as<int>(), 0, 21);
+        if (!doc["ledColorOrder"].isNull()) strlcpy(ledColorOrder, doc["ledColorOrder"].as<const char*>(), sizeof(ledColorOrder));
+        if (!doc["printerSegments"].isNull()) strlcpy(printerSegments, doc["printerSegments"].as<const char*>(), sizeof(printerSegments));
         saveConfig();
+        ledConfigChanged();
+        mqttConfigChanged();
         appendLog("BLE 配置更新成功");
     } else if (action == "set_force") {
         String mode = doc["mode"].as<const char*>();
@@ -116,8 +132,7 @@ void handleBLECommand(const String& command) {
         }
         appendLog("BLE 设置强制模式: " + mode);
     } else if (action == "test_led") {
-        testingLed = true;
-        testLedIndex = 0;
+        startLedTest();
         appendLog("BLE 启动 LED 测试");
     } else if (action == "reset") {
         appendLog("BLE 请求软重启");
@@ -137,51 +152,47 @@ void handleBLECommand(const String& command) {
     }
 }
 
-// 获取 BLE 状态响应
-String getBLEStatusResponse() {
+// 获取 BLE 状态响应：直接序列化到调用方缓冲区，返回写入长度（放不下时返回 0）
+size_t writeBLEStatusResponse(char* out, size_t size) {
     StaticJsonDocument<512> doc;
-    doc["state"] = getStateText(getState());
-    doc["forcedMode"] = getForcedModeText(getForcedMode());
-    doc["printPercent"] = printPercent;
-    doc["gcodeState"] = gcodeState;
-    doc["remainingTime"] = remainingTime;
-    doc["layerNum"] = layerNum;
-    doc["totalLayerNum"] = totalLayerNum;
-    doc["nozzleTemper"] = nozzleTemper;
-    doc["bedTemper"] = bedTemper;
-    doc["chamberTemper"] = chamberTemper;
-    doc["wifiSignal"] = wifiSignal;
-    doc["spdLvl"] = spdLvl;
+    JsonObject root = doc.to<JsonObject>();
+    root["state"] = getStateText(getState());
+    root["forcedMode"] = getForcedModeText(getForcedMode());
+    fillPrinterStatus(root);
+    fillLedStatus(root["led"].to<JsonObject>());
+    fillLatencyStats(root["latency"].to<JsonObject>());
 
-    // 解析 LED 状态
-    StaticJsonDocument<256> ledDoc;
-    DeserializationError ledError = deserializeJson(ledDoc, getLedStatus());
-    if (!ledError) {
-        doc["led"] = ledDoc;
-    } else {
-        doc["led"] = nullptr;
-        appendLog("LED 状态解析失败: " + String(ledError.code()));
+    if (measureJson(doc) >= size) {
+        appendLog("BLE 状态响应超出缓冲区");
+        return 0;
     }
-
-    String output;
-    serializeJson(doc, output);
-    return output;
+    return serializeJson(doc, out, size);
 }
 
 // 获取 BLE 配置响应
 String getBLEConfigResponse() {
-    StaticJsonDocument<512> doc;
+    StaticJsonDocument<768> doc;
     doc["uid"] = uid;
     doc["accessToken"] = accessToken;
     doc["deviceID"] = deviceID;
+    doc["mqttMode"] = mqttMode;
+    doc["printerHost"] = printerHost;
+    doc["accessCode"] = accessCode;
+    doc["mqttPort"] = mqttPort;
+    doc["mqttTls"] = mqttTls;
     doc["customPushallInterval"] = customPushallInterval;
     doc["progressBarColor"] = progressBarColor;
     doc["standbyBreathingColor"] = standbyBreathingColor;
     doc["progressBarBrightnessRatio"] = progressBarBrightnessRatio;
     doc["standbyBrightnessRatio"] = standbyBrightnessRatio;
     doc["standbyMode"] = standbyMode;
+    doc["progressSource"] = progressSource;
     doc["overlayMarquee"] = overlayMarquee;
     doc["globalBrightness"] = globalBrightness;
+    doc["ledCount"] = ledCount;
+    doc["ledPin"] = ledPin;
+    doc["ledColorOrder"] = ledColorOrder;
+    doc["printerSegments"] = printerSegments;
     String output;
     serializeJson(doc, output);
     return output;
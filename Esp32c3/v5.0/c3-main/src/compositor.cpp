@@ -0,0 +1,304 @@
+#include "compositor.h"
+#include "lut.h"
+
+// 准备、打印和暂停都显示进度条，FAILED 显示告警，其余（IDLE、FINISH 等）按待机处理
+PrinterPhase gcodePhase(const char* gcodeState) {
+    if (strcmp(gcodeState, "RUNNING") == 0 || strcmp(gcodeState, "PREPARE") == 0
+        || strcmp(gcodeState, "PAUSE") == 0) return PHASE_PRINTING;
+    if (strcmp(gcodeState, "FAILED") == 0) return PHASE_FAILED;
+    return PHASE_IDLE;
+}
+
+ProgressSource parseProgressSource(const char* source) {
+    if (strcmp(source, "percent") == 0) return PS_PERCENT;
+    if (strcmp(source, "layers") == 0) return PS_LAYERS;
+    if (strcmp(source, "time") == 0) return PS_TIME;
+    return PS_AUTO;
+}
+
+// --- 图层合成 ---
+// 每个场景是一组自下而上叠加的图层，各图层按整数 alpha 混合进共享帧缓冲
+enum LayerKind : uint8_t {
+    LAYER_FILL,       // 区域纯色
+    LAYER_PROGRESS,   // 区域对应打印机的进度条
+    LAYER_BREATHING,  // 区域呼吸
+    LAYER_FLASH,      // 区域以 1Hz 闪烁，用于告警
+    LAYER_MARQUEE     // 单个白色像素在区域内循环移动
+};
+
+// 图层颜色来源：固定色或用户配置色
+enum ColorSource : uint8_t { CS_FIXED, CS_PROGRESS, CS_STANDBY };
+
+// 场景的整体亮度来源
+enum BrightnessSource : uint8_t { BS_GLOBAL, BS_PROGRESS, BS_STANDBY };
+
+struct LayerSpec {
+    LayerKind kind;
+    ColorSource source;
+    uint32_t color;
+    uint8_t alpha;
+};
+
+static const uint8_t MAX_SCENE_LAYERS = 2;
+
+struct Scene {
+    LayerSpec layers[MAX_SCENE_LAYERS];
+    uint8_t layerCount;
+    BrightnessSource brightness;
+};
+
+enum SceneId : uint8_t {
+    SCENE_AP, SCENE_CONNECTING_WIFI, SCENE_CONNECTED_WIFI, SCENE_CONNECTING_PRINTER,
+    SCENE_CONNECTED_PRINTER, SCENE_PROGRESS, SCENE_PRINTING_FILL, SCENE_STANDBY_SOLID,
+    SCENE_STANDBY_BREATHING, SCENE_FAILED, SCENE_COUNT
+};
+
+static const Scene SCENES[SCENE_COUNT] = {
+    { { { LAYER_FILL, CS_FIXED, 0x0000FF, 255 } }, 1, BS_GLOBAL },           // SCENE_AP
+    { { { LAYER_FILL, CS_FIXED, 0xFFFF00, 255 } }, 1, BS_GLOBAL },           // SCENE_CONNECTING_WIFI
+    { { { LAYER_FILL, CS_FIXED, 0x00FF00, 255 } }, 1, BS_GLOBAL },           // SCENE_CONNECTED_WIFI
+    { { { LAYER_FILL, CS_FIXED, 0xFF00FF, 255 } }, 1, BS_GLOBAL },           // SCENE_CONNECTING_PRINTER
+    { { { LAYER_FILL, CS_FIXED, 0x00FFFF, 255 } }, 1, BS_GLOBAL },           // SCENE_CONNECTED_PRINTER
+    { { { LAYER_PROGRESS, CS_PROGRESS, 0, 255 } }, 1, BS_PROGRESS },         // SCENE_PROGRESS
+    { { { LAYER_FILL, CS_FIXED, 0xFF0000, 255 } }, 1, BS_GLOBAL },           // SCENE_PRINTING_FILL
+    { { { LAYER_FILL, CS_STANDBY, 0, 255 } }, 1, BS_STANDBY },               // SCENE_STANDBY_SOLID
+    { { { LAYER_BREATHING, CS_STANDBY, 0, 255 } }, 1, BS_STANDBY },          // SCENE_STANDBY_BREATHING
+    { { { LAYER_FILL, CS_FIXED, 0x400000, 255 },
+        { LAYER_FLASH, CS_FIXED, 0xFF0000, 255 } }, 2, BS_GLOBAL },          // SCENE_FAILED
+};
+
+// 状态/强制模式到场景的映射，下标与枚举一致
+static const SceneId STATE_SCENES[] = {
+    SCENE_AP, SCENE_CONNECTING_WIFI, SCENE_CONNECTED_WIFI, SCENE_CONNECTING_PRINTER,
+    SCENE_CONNECTED_PRINTER, SCENE_PROGRESS, SCENE_FAILED
+};
+static const SceneId FORCED_SCENES[] = {
+    SCENE_AP, SCENE_PROGRESS, SCENE_STANDBY_SOLID, SCENE_AP, SCENE_CONNECTING_WIFI,
+    SCENE_CONNECTED_WIFI, SCENE_CONNECTING_PRINTER, SCENE_CONNECTED_PRINTER,
+    SCENE_PRINTING_FILL, SCENE_FAILED
+};
+
+static const LayerSpec MARQUEE_LAYER = { LAYER_MARQUEE, CS_FIXED, 0xFFFFFF, 255 };
+
+static SceneId standbyScene(const LedSnapshot& snap) {
+    return snap.standbyBreathing ? SCENE_STANDBY_BREATHING : SCENE_STANDBY_SOLID;
+}
+
+// 分段的场景由该打印机自己的 gcode_state 决定，强制进度模式时一律显示进度
+static SceneId printerScene(const LedSnapshot& snap, uint8_t s) {
+    if (snap.forcedMode == PROGRESS) return SCENE_PROGRESS;
+    switch (snap.phase[s]) {
+        case PHASE_PRINTING: return SCENE_PROGRESS;
+        case PHASE_FAILED: return SCENE_FAILED;
+        default: return standbyScene(snap);
+    }
+}
+
+// 整条灯带共用的场景：连上打印机之前的设备状态，以及进度以外的强制模式
+static SceneId stripScene(const LedSnapshot& snap) {
+    if (snap.forcedMode == NONE) return STATE_SCENES[snap.state];
+    if (snap.forcedMode == STANDBY) return standbyScene(snap);
+    return FORCED_SCENES[snap.forcedMode];
+}
+
+static bool isAnimated(LayerKind kind) {
+    return kind == LAYER_BREATHING || kind == LAYER_FLASH || kind == LAYER_MARQUEE;
+}
+
+// 按 Q8 alpha 把 src 混合到 dst 上，255 完全覆盖
+static uint32_t blendPixel(uint32_t dst, uint32_t src, uint8_t alpha) {
+    uint16_t w = alpha + (alpha >> 7);
+    uint16_t inv = 256 - w;
+    uint32_t r = (((dst >> 16) & 0xFF) * inv + ((src >> 16) & 0xFF) * w) >> 8;
+    uint32_t g = (((dst >> 8) & 0xFF) * inv + ((src >> 8) & 0xFF) * w) >> 8;
+    uint32_t b = ((dst & 0xFF) * inv + (src & 0xFF) * w) >> 8;
+    return (r << 16) | (g << 8) | b;
+}
+
+// 按 Q8 比例缩放颜色
+static uint32_t scaleColor(uint32_t color, uint8_t scale) {
+    uint16_t s = scale + 1;
+    return ((((color >> 16) & 0xFF) * s >> 8) << 16) | ((((color >> 8) & 0xFF) * s >> 8) << 8) | ((color & 0xFF) * s >> 8);
+}
+
+static uint8_t sceneBrightness(const LedSnapshot& snap, BrightnessSource source) {
+    switch (source) {
+        case BS_PROGRESS: return snap.progressBrightness;
+        case BS_STANDBY: return snap.standbyBrightness;
+        default: return snap.globalBrightness;
+    }
+}
+
+// --- 进度来源 ---
+// 进度统一用 Q8 百分比表示（25600 为 100%）。percent 只有整数精度；layers 按层数换算；
+// time 以最近一次报告为锚点按剩余时间线性推进，但不越过打印机下一次会报告的整数百分比。
+// auto 在数据可用时依次选 time、layers、percent
+static const uint32_t PROGRESS_FULL_Q8 = Compositor::PROGRESS_FULL_Q8;
+
+static uint32_t layerProgressQ8(const LedSnapshot& snap, uint8_t s) {
+    int32_t total = snap.totalLayerNum[s];
+    return (uint32_t)constrain((int32_t)snap.layerNum[s], (int32_t)0, total) * PROGRESS_FULL_Q8 / total;
+}
+
+static uint32_t timeProgressQ8(const LedSnapshot& snap, uint8_t s, unsigned long now) {
+    uint32_t percentQ8 = (uint32_t)constrain((int32_t)snap.printPercent[s], (int32_t)0, (int32_t)100) << 8;
+    if (percentQ8 >= PROGRESS_FULL_Q8) return PROGRESS_FULL_Q8;
+    uint32_t ceilingQ8 = percentQ8 + 255;
+    // 层数只在当前整数百分比内细化起点
+    uint32_t anchorQ8 = percentQ8;
+    if (snap.totalLayerNum[s] > 0) anchorQ8 = constrain(layerProgressQ8(snap, s), percentQ8, ceilingQ8);
+    if (!snap.running[s]) return anchorQ8;
+    uint32_t spanMs = (uint32_t)snap.remainingTime[s] * 60000UL;
+    uint32_t elapsed = min((uint32_t)(now - snap.anchorMs[s]), spanMs);
+    uint32_t estimate = anchorQ8 + (uint64_t)(PROGRESS_FULL_Q8 - anchorQ8) * elapsed / spanMs;
+    return min(estimate, ceilingQ8);
+}
+
+uint32_t Compositor::progressQ8(const LedSnapshot& snap, uint8_t s, unsigned long now) {
+    ProgressSource source = snap.progressSource;
+    bool useTime = snap.remainingTime[s] > 0 && (source == PS_TIME || source == PS_AUTO);
+    bool useLayers = snap.totalLayerNum[s] > 0 && source != PS_PERCENT;
+    uint32_t q8;
+    if (useTime) {
+        q8 = timeProgressQ8(snap, s, now);
+    } else if (useLayers) {
+        q8 = layerProgressQ8(snap, s);
+    } else {
+        q8 = (uint32_t)constrain((int32_t)snap.printPercent[s], (int32_t)0, (int32_t)100) << 8;
+    }
+    // 明显倒退（新的一次打印或切换了来源）时直接跟随，小幅回退则保持不动
+    if (q8 + 512 < shownProgress[s] || q8 > shownProgress[s]) shownProgress[s] = q8;
+    return shownProgress[s];
+}
+
+Compositor::~Compositor() {
+    free(frame);
+    free(lastFrame);
+}
+
+bool Compositor::begin(uint16_t length) {
+    free(frame);
+    free(lastFrame);
+    frame = (uint32_t*)calloc(length, sizeof(uint32_t));
+    lastFrame = (uint32_t*)calloc(length, sizeof(uint32_t));
+    lastFrameValid = false;
+    stripLength = frame && lastFrame ? length : 0;
+    return stripLength == length;
+}
+
+void Compositor::setSink(PixelSink* next) {
+    sink = next;
+    lastFrameValid = false;
+}
+
+void Compositor::startTest() {
+    testingLed = true;
+    testLedIndex = 0;
+}
+
+// 按快照划分本帧的区域
+void Compositor::buildRegions(const LedSnapshot& snap) {
+    bool perPrinter = snap.forcedMode == PROGRESS || (snap.forcedMode == NONE && snap.state >= CONNECTED_PRINTER);
+    if (!perPrinter) {
+        regions[0] = { 0, stripLength, 0, stripScene(snap) };
+        regionCount = 1;
+        return;
+    }
+    regionCount = snap.segmentCount;
+    for (uint8_t s = 0; s < regionCount; s++) {
+        regions[s] = { snap.segments[s].start, snap.segments[s].length, s, printerScene(snap, s) };
+    }
+}
+
+void Compositor::blendRange(int start, int length, uint32_t color, uint8_t alpha) {
+    for (int i = start; i < start + length && i < stripLength; i++) {
+        frame[i] = blendPixel(frame[i], color, alpha);
+    }
+}
+
+// 区域内按 Q8 像素绘制进度：整颗灯珠完全覆盖，末尾灯珠按小数部分的比例混合
+void Compositor::renderProgress(const Region& region, uint32_t q8, uint32_t color, uint8_t alpha) {
+    uint32_t litQ8 = (uint32_t)region.length * q8 / 100;
+    uint16_t full = litQ8 >> 8;
+    blendRange(region.start, full, color, alpha);
+    if (full < region.length) {
+        blendRange(region.start + full, 1, color, (uint8_t)((alpha * (litQ8 & 0xFF)) >> 8));
+    }
+}
+
+// 所有图层都只画在区域之内，一帧里可以同时合成多台打印机各自的场景
+void Compositor::renderLayer(const LayerSpec& layer, const Region& region, const LedSnapshot& snap, unsigned long now) {
+    uint32_t color = layer.source == CS_PROGRESS ? snap.progressBarColor
+                   : layer.source == CS_STANDBY ? snap.standbyColor
+                   : layer.color;
+    switch (layer.kind) {
+        case LAYER_FILL:
+            blendRange(region.start, region.length, color, layer.alpha);
+            break;
+        case LAYER_PROGRESS:
+            renderProgress(region, progressQ8(snap, region.slot, now), color, layer.alpha);
+            break;
+        case LAYER_BREATHING: {
+            // 周期约 2π 秒，与原先 sin(millis() / 1000.0) 一致
+            uint8_t wave = lutSine8((uint8_t)(((now % 6283) << 8) / 6283));
+            blendRange(region.start, region.length, scaleColor(color, lutGamma8(wave)), layer.alpha);
+            break;
+        }
+        case LAYER_FLASH:
+            if ((now / 500) % 2) blendRange(region.start, region.length, color, layer.alpha);
+            break;
+        case LAYER_MARQUEE:
+            blendRange(region.start + marqueeStep % region.length, 1, color, layer.alpha);
+            break;
+    }
+}
+
+// 后台缓冲与前台比较，像素没变时跳过输出，避免 show() 无谓地关中断；亮度已折算进像素
+// 有变化时交换前后台指针，输出端只会看到完整合成好的帧
+bool Compositor::present() {
+    if (lastFrameValid && memcmp(frame, lastFrame, stripLength * sizeof(uint32_t)) == 0) {
+        skippedCount++;
+        return false;
+    }
+    uint32_t* shown = frame;
+    frame = lastFrame;
+    lastFrame = shown;
+    lastFrameValid = true;
+    if (sink) sink->writeFrame(lastFrame, stripLength);
+    shownCount++;
+    return true;
+}
+
+bool Compositor::render(const LedSnapshot& snap, unsigned long now) {
+    if (stripLength == 0) return false;
+    memset(frame, 0, stripLength * sizeof(uint32_t));
+    if (testingLed) {
+        frameBrightness = snap.globalBrightness;
+        frame[testLedIndex] = scaleColor(0xFFFFFF, frameBrightness);
+        testLedIndex = (testLedIndex + 1) % stripLength;
+        if (testLedIndex == 0) testingLed = false;
+        animatedFrame = true;
+    } else {
+        // 每个区域自下而上合成自己的场景，跑马灯作为可选叠加层放在最上面，亮度也按区域的场景折算
+        buildRegions(snap);
+        animatedFrame = snap.overlayMarquee;
+        for (uint8_t r = 0; r < regionCount; r++) {
+            const Region& region = regions[r];
+            if (region.length == 0) continue;
+            const Scene& scene = SCENES[region.scene];
+            for (uint8_t l = 0; l < scene.layerCount; l++) {
+                renderLayer(scene.layers[l], region, snap, now);
+                if (isAnimated(scene.layers[l].kind)) animatedFrame = true;
+            }
+            if (snap.overlayMarquee) renderLayer(MARQUEE_LAYER, region, snap, now);
+
+            uint8_t brightness = sceneBrightness(snap, scene.brightness);
+            for (int i = region.start; i < region.start + region.length && i < stripLength; i++) {
+                frame[i] = scaleColor(frame[i], brightness);
+            }
+            if (r == 0) frameBrightness = brightness;
+        }
+        marqueeStep++;
+    }
+    return present();
+}
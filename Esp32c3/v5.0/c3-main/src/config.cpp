@@ -3,31 +3,76 @@
 #include <LittleFS.h>
 #include <ArduinoJson.h>
 #include "utils.h"
+#include "led.h"
 
 // 配置变量
 char uid[64] = "";
 char accessToken[64] = "";
 char deviceID[32] = "";
+char mqttMode[8] = "cloud";      // "cloud" 走拓竹云，"lan" 直连打印机局域网 Broker
+char printerHost[64] = "";       // 局域网模式下打印机 IP 或主机名
+char accessCode[16] = "";        // 局域网模式下打印机屏幕上的访问码
+int mqttPort = 8883;
+bool mqttTls = true;             // 测试时可关闭 TLS，连接普通 mosquitto
 int customPushallInterval = 5000;
 uint32_t progressBarColor = 0xFF0000;
 uint32_t standbyBreathingColor = 0x00FF00;
 float progressBarBrightnessRatio = 1.0;
 float standbyBrightnessRatio = 0.5;
 char standbyMode[16] = "breathing";
+char progressSource[8] = "auto";  // 进度来源：auto / percent / layers / time
 bool overlayMarquee = false;
 uint8_t globalBrightness = 255;
+uint16_t ledCount = DEFAULT_LED_COUNT;
+uint8_t ledPin = DEFAULT_LED_PIN;
+char ledColorOrder[4] = "GRB";   // 灯珠的颜色字节顺序，WS2812 为 GRB
+char printerSegments[256] = "";  // "序列号:起始:长度,..."，为空时只跟随 deviceID 并占满整条灯带
+PrinterSegment segments[MAX_PRINTERS];
+uint8_t segmentCount = 0;
 
-// 打印机状态变量
-int printPercent = 0;
-String gcodeState = "IDLE";
-int remainingTime = 0;
-int layerNum = 0;
-int totalLayerNum = 0;
-float nozzleTemper = 0.0;
-float bedTemper = 0.0;
-float chamberTemper = 0.0;
-String wifiSignal = "";
-int spdLvl = 1;
+// 是否直连打印机局域网 Broker
+bool isLanMode() {
+    return strcmp(mqttMode, "lan") == 0;
+}
+
+// MQTT 必要参数是否齐全：云端需要 UID/令牌，局域网需要打印机地址/访问码
+bool isMqttConfigured() {
+    if (strlen(deviceID) == 0) return false;
+    if (isLanMode()) return strlen(printerHost) > 0 && strlen(accessCode) > 0;
+    return strlen(uid) > 0 && strlen(accessToken) > 0;
+}
+
+// 把 printerSegments 解析成分段表；局域网模式只能连接一台打印机，忽略分段配置
+void parsePrinterSegments() {
+    segmentCount = 0;
+    if (!isLanMode()) {
+        char list[sizeof(printerSegments)];
+        strlcpy(list, printerSegments, sizeof(list));
+        char* save = nullptr;
+        for (char* item = strtok_r(list, ",;", &save); item && segmentCount < MAX_PRINTERS; item = strtok_r(nullptr, ",;", &save)) {
+            while (*item == ' ') item++;
+            char* startText = strchr(item, ':');
+            if (!startText) continue;
+            *startText++ = '\0';
+            char* lengthText = strchr(startText, ':');
+            if (!lengthText) continue;
+            *lengthText++ = '\0';
+            int start = atoi(startText);
+            int length = atoi(lengthText);
+            if (*item == '\0' || start < 0 || start >= ledCount || length <= 0) continue;
+            PrinterSegment& seg = segments[segmentCount++];
+            strlcpy(seg.deviceID, item, sizeof(seg.deviceID));
+            seg.start = start;
+            seg.length = min(length, ledCount - start);
+        }
+    }
+    if (segmentCount == 0) {
+        strlcpy(segments[0].deviceID, deviceID, sizeof(segments[0].deviceID));
+        segments[0].start = 0;
+        segments[0].length = ledCount;
+        segmentCount = 1;
+    }
+}
 
 // 加载配置文件
 void loadConfig() {
@@ -43,7 +88,7 @@ void loadConfig() {
         return;
     }
 
-    StaticJsonDocument<512> doc;
+    StaticJsonDocument<768> doc;
     DeserializationError error = deserializeJson(doc, file);
     file.close();
 
@@ -55,14 +100,24 @@ void loadConfig() {
     strlcpy(uid, doc["uid"] | "", sizeof(uid));
     strlcpy(accessToken, doc["accessToken"] | "", sizeof(accessToken));
     strlcpy(deviceID, doc["deviceID"] | "", sizeof(deviceID));
+    strlcpy(mqttMode, doc["mqttMode"] | "cloud", sizeof(mqttMode));
+    strlcpy(printerHost, doc["printerHost"] | "", sizeof(printerHost));
+    strlcpy(accessCode, doc["accessCode"] | "", sizeof(accessCode));
+    mqttPort = doc["mqttPort"] | 8883;
+    mqttTls = doc["mqttTls"] | true;
     customPushallInterval = doc["customPushallInterval"] | 5000;
     progressBarColor = doc["progressBarColor"] | 0xFF0000;
     standbyBreathingColor = doc["standbyBreathingColor"] | 0x00FF00;
     progressBarBrightnessRatio = doc["progressBarBrightnessRatio"] | 1.0;
     standbyBrightnessRatio = doc["standbyBrightnessRatio"] | 0.5;
     strlcpy(standbyMode, doc["standbyMode"] | "breathing", sizeof(standbyMode));
+    strlcpy(progressSource, doc["progressSource"] | "auto", sizeof(progressSource));
     overlayMarquee = doc["overlayMarquee"] | false;
     globalBrightness = doc["globalBrightness"] | 255;
+    ledCount = constrain(doc["ledCount"] | DEFAULT_LED_COUNT, 1, MAX_LED_COUNT);
+    ledPin = constrain(doc["ledPin"] | DEFAULT_LED_PIN, 0, 21);
+    strlcpy(ledColorOrder, doc["ledColorOrder"] | "GRB", sizeof(ledColorOrder));
+    strlcpy(printerSegments, doc["printerSegments"] | "", sizeof(printerSegments));
 
     appendLog(F("配置加载成功"));
 }
@@ -74,18 +129,28 @@ void saveConfig() {
         return;
     }
 
-    StaticJsonDocument<512> doc;
+    StaticJsonDocument<768> doc;
     doc["uid"] = uid;
     doc["accessToken"] = accessToken;
     doc["deviceID"] = deviceID;
+    doc["mqttMode"] = mqttMode;
+    doc["printerHost"] = printerHost;
+    doc["accessCode"] = accessCode;
+    doc["mqttPort"] = mqttPort;
+    doc["mqttTls"] = mqttTls;
     doc["customPushallInterval"] = customPushallInterval;
     doc["progressBarColor"] = progressBarColor;
     doc["standbyBreathingColor"] = standbyBreathingColor;
     doc["progressBarBrightnessRatio"] = progressBarBrightnessRatio;
     doc["standbyBrightnessRatio"] = standbyBrightnessRatio;
     doc["standbyMode"] = standbyMode;
+    doc["progressSource"] = progressSource;
     doc["overlayMarquee"] = overlayMarquee;
     doc["globalBrightness"] = globalBrightness;
+    doc["ledCount"] = ledCount;
+    doc["ledPin"] = ledPin;
+    doc["ledColorOrder"] = ledColorOrder;
+    doc["printerSegments"] = printerSegments;
 
     File file = LittleFS.open("/config.json", "w");
     if (!file) {
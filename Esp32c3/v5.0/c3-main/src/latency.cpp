@@ -0,0 +1,133 @@
+#include "latency.h"
+
+// 每个阶段用固定分桶的直方图统计：桶宽为四分之一个二进制量级（相对误差不超过 25%），
+// 0-3 微秒各占一个桶，uint32 的全部范围共 124 个桶。
+// 滚动窗口由两个半窗组成：当前半窗攒满 LATENCY_EPOCH 个样本后成为上一半窗，统计时合并两者，
+// 所以 min/avg/p99 总是覆盖最近 LATENCY_EPOCH 到 2 * LATENCY_EPOCH 个样本
+static const uint8_t LATENCY_BUCKETS = 124;
+static const uint16_t LATENCY_EPOCH = 256;
+
+struct LatencyEpoch {
+    uint16_t buckets[LATENCY_BUCKETS];
+    uint16_t count;
+    uint32_t min;     // count 为 0 时无意义
+    uint64_t sum;
+};
+
+struct LatencyHistogram {
+    LatencyEpoch current;
+    LatencyEpoch previous;
+};
+
+static LatencyHistogram histograms[LS_COUNT];
+static uint32_t sampleCount = 0;    // 累计样本数，/status 据此判断统计是否有更新
+static const char* const STAGE_NAMES[LS_COUNT] = { "parse", "render", "total" };
+
+static uint32_t arrivedAt = 0;      // 当前报告到达时间
+static uint32_t pendingArrival = 0; // 等待渲染的报告到达时间
+static uint32_t pendingMerged = 0;  // 等待渲染的快照更新时间
+static bool framePending = false;
+// 报告在主循环中合并、帧在渲染任务中输出，两边共享的状态用自旋锁保护
+static portMUX_TYPE latencyMux = portMUX_INITIALIZER_UNLOCKED;
+
+// 最高位决定量级，其下两位决定量级内的四个子桶
+static uint8_t bucketOf(uint32_t micros) {
+    if (micros < 4) return micros;
+    uint8_t msb = 31 - __builtin_clz(micros);
+    return (msb - 1) * 4 + ((micros >> (msb - 2)) & 3);
+}
+
+// 桶内最大的值，p99 取所在桶的上界，只会偏大不会偏小
+static uint32_t bucketUpper(uint8_t bucket) {
+    if (bucket < 4) return bucket;
+    uint8_t shift = bucket / 4 - 1;
+    uint32_t lower = (uint32_t)(4 + bucket % 4) << shift;
+    return lower + ((1UL << shift) - 1);
+}
+
+static void resetEpoch(LatencyEpoch& e) {
+    memset(e.buckets, 0, sizeof(e.buckets));
+    e.count = 0;
+    e.min = 0;
+    e.sum = 0;
+}
+
+static void record(LatencyStage stage, uint32_t micros) {
+    LatencyHistogram& h = histograms[stage];
+    if (h.current.count == LATENCY_EPOCH) {
+        h.previous = h.current;
+        resetEpoch(h.current);
+    }
+    LatencyEpoch& e = h.current;
+    e.buckets[bucketOf(micros)]++;
+    e.min = e.count == 0 ? micros : min(e.min, micros);
+    e.count++;
+    e.sum += micros;
+    sampleCount++;
+}
+
+// 报告开始解析前调用，传入 mqttCallback 收到它时的 micros()
+void latencyReportArrived(uint32_t at) {
+    arrivedAt = at;
+}
+
+// 报告合并进快照后调用；只有快照真的变化才需要等待下一帧
+void latencyReportMerged(bool changed) {
+    uint32_t now = micros();
+    portENTER_CRITICAL(&latencyMux);
+    record(LS_PARSE, now - arrivedAt);
+    if (changed) {
+        // 多条报告合并到同一帧时，以最早到达的那条计算总延迟
+        if (!framePending) {
+            pendingArrival = arrivedAt;
+            framePending = true;
+        }
+        pendingMerged = now;
+    }
+    portEXIT_CRITICAL(&latencyMux);
+}
+
+// 每帧合成完成后调用（无论 strip.show() 是否因画面未变而跳过）
+void latencyFrameShown() {
+    uint32_t now = micros();
+    portENTER_CRITICAL(&latencyMux);
+    if (framePending) {
+        record(LS_RENDER, now - pendingMerged);
+        record(LS_TOTAL, now - pendingArrival);
+        framePending = false;
+    }
+    portEXIT_CRITICAL(&latencyMux);
+}
+
+uint32_t latencySampleCount() {
+    portENTER_CRITICAL(&latencyMux);
+    uint32_t count = sampleCount;
+    portEXIT_CRITICAL(&latencyMux);
+    return count;
+}
+
+// 输出各阶段统计：{"parse":{"n":..,"min":..,"avg":..,"p99":..},...}，单位微秒；
+// p99 是第 99 百分位所在桶的上界
+void fillLatencyStats(JsonObject out) {
+    for (uint8_t s = 0; s < LS_COUNT; s++) {
+        portENTER_CRITICAL(&latencyMux);
+        LatencyHistogram h = histograms[s];
+        portEXIT_CRITICAL(&latencyMux);
+        uint32_t count = h.current.count + h.previous.count;
+        JsonObject stage = out[STAGE_NAMES[s]].to<JsonObject>();
+        stage["n"] = count;
+        if (count == 0) continue;
+        // 有样本时当前半窗一定不为空
+        stage["min"] = h.previous.count == 0 ? h.current.min : min(h.current.min, h.previous.min);
+        stage["avg"] = (uint32_t)((h.current.sum + h.previous.sum) / count);
+        uint32_t rank = (count * 99 + 99) / 100;   // 第 rank 个样本（从 1 开始）即 p99
+        uint32_t seen = 0;
+        for (uint8_t b = 0; b < LATENCY_BUCKETS; b++) {
+            seen += h.current.buckets[b] + h.previous.buckets[b];
+            if (seen >= rank) {
+                stage["p99"] = bucketUpper(b);
+                break;
+            }
+        }
+    }
+}
@@ -1,23 +1,133 @@
 #include "led.h"
 #include "config.h"
 #include "utils.h"
+#include "printer.h"
+#include "latency.h"
+#include "compositor.h"
 #include <Adafruit_NeoPixel.h>
 #include <ArduinoJson.h>
 
-Adafruit_NeoPixel strip(LED_COUNT, LED_PIN, NEO_GRB + NEO_KHZ800);
-bool testingLed = false;
-int testLedIndex = 0;
+Adafruit_NeoPixel strip;   // 长度、引脚和颜色顺序在 setupLED 中按配置设置
+
+// 默认输出端：把帧写进 NeoPixel 缓冲区并刷新灯带
+class NeoPixelSink : public PixelSink {
+public:
+    void writeFrame(const uint32_t* pixels, uint16_t count) override {
+        for (uint16_t i = 0; i < count; i++) {
+            strip.setPixelColor(i, pixels[i]);
+        }
+        strip.show();
+    }
+};
+static NeoPixelSink neoPixelSink;
+static Compositor compositor;   // 只在渲染任务中调用 render，其余地方只读统计值
+static volatile bool testRequested = false;   // 其他任务通过 startLedTest() 发请求，由渲染任务转交给合成器
 static State currentState = AP_MODE;
 static ForcedMode forcedMode = NONE;
 
+// 帧调度：动画灯效按 ANIMATED_FPS 合成，静态画面只按 STATIC_FPS 兜底重算
+static const uint8_t ANIMATED_FPS = 30;
+static const uint8_t STATIC_FPS = 2;
+static unsigned long lastFrameAt = 0;
+static volatile bool frameDue = true;   // 状态/配置变化后立即合成下一帧
+
+// 渲染在独立任务中按固定周期运行，优先级高于 loop()，网络卡顿不会拖慢动画
+static const uint32_t LED_TASK_STACK = 4096;
+static const UBaseType_t LED_TASK_PRIORITY = 2;
+static TaskHandle_t ledTaskHandle = nullptr;
+
+// 渲染任务使用的快照：主循环发布，渲染任务每帧开始时整体拷贝一份只读副本
+static LedSnapshot publishedSnapshot;
+static LedSnapshot frameSnapshot;
+static portMUX_TYPE snapshotMux = portMUX_INITIALIZER_UNLOCKED;
+static volatile bool snapshotDirty = true;   // 配置或状态变了，下次发布时即使打印机没有变化也要重发
+static uint32_t lastRenderMicros = 0;   // 最近一帧合成加输出的耗时
+
+// 请求渲染任务立即合成一帧
+void requestLedFrame() {
+    frameDue = true;
+    if (ledTaskHandle) xTaskNotifyGive(ledTaskHandle);
+}
+
+// 配置或状态被修改后调用，下一次 publishLedSnapshot() 会带上新值
+void ledConfigChanged() {
+    snapshotDirty = true;
+}
+
+// 请求渲染任务从第一颗开始逐颗点亮测试
+void startLedTest() {
+    testRequested = true;
+    requestLedFrame();
+}
+
+static uint8_t ratioBrightness(float ratio) {
+    return constrain(globalBrightness * ratio, 0, 255);
+}
+
+// 主循环调用：打印机状态或配置有变化时发布新快照并唤醒渲染任务
+void publishLedSnapshot() {
+    static const uint16_t interest = PF_GCODE_STATE | PF_PRINT_PERCENT | PF_LAYER_NUM | PF_TOTAL_LAYER_NUM | PF_REMAINING_TIME;
+    // 两个条件都要求值，保证打印机变化位总被取走
+    bool printerChanged = takePrinterChanges(PC_LED, interest) != 0;
+    if (!printerChanged && !snapshotDirty) return;
+    snapshotDirty = false;
+    LedSnapshot next = publishedSnapshot;   // 只在主循环中读写，不需要加锁
+    uint32_t now = millis();
+    for (uint8_t s = 0; s < MAX_PRINTERS; s++) {
+        const PrinterSnapshot& p = printers[s];
+        bool running = strcmp(p.gcodeState, "RUNNING") == 0;
+        // 进度相关字段都没变时保留原锚点，否则每次 pushall 都会把推算拉回起点；
+        // 暂停/恢复时也要重新锚定，暂停期间不能算作已经过去的打印时间
+        if (p.printPercent != next.printPercent[s] || p.layerNum != next.layerNum[s]
+            || p.remainingTime != next.remainingTime[s] || running != next.running[s]) {
+            next.anchorMs[s] = now;
+        }
+        next.printPercent[s] = p.printPercent;
+        next.layerNum[s] = p.layerNum;
+        next.totalLayerNum[s] = p.totalLayerNum;
+        next.remainingTime[s] = p.remainingTime;
+        next.running[s] = running;
+        next.phase[s] = gcodePhase(p.gcodeState);
+    }
+    memcpy(next.segments, segments, sizeof(next.segments));
+    next.segmentCount = segmentCount;
+    next.state = currentState;
+    next.forcedMode = forcedMode;
+    next.progressBarColor = progressBarColor;
+    next.standbyColor = standbyBreathingColor;
+    next.globalBrightness = globalBrightness;
+    next.progressBrightness = ratioBrightness(progressBarBrightnessRatio);
+    next.standbyBrightness = ratioBrightness(standbyBrightnessRatio);
+    next.progressSource = parseProgressSource(progressSource);
+    next.standbyBreathing = strcmp(standbyMode, "breathing") == 0;
+    next.overlayMarquee = overlayMarquee;
+    portENTER_CRITICAL(&snapshotMux);
+    publishedSnapshot = next;
+    portEXIT_CRITICAL(&snapshotMux);
+    requestLedFrame();
+}
+
+// 替换输出端，传 nullptr 恢复为灯带；切换后下一帧一定会输出
+void setPixelSink(PixelSink* sink) {
+    compositor.setSink(sink ? sink : &neoPixelSink);
+}
+
 // 设置当前状态
-void setState(State state) { currentState = state; }
+void setState(State state) {
+    if (state == currentState) return;
+    currentState = state;
+    ledConfigChanged();
+}
 
 // 获取当前状态
 State getState() { return currentState; }
 
 // 设置强制模式
-void setForcedMode(ForcedMode mode) { forcedMode = mode; }
+void setForcedMode(ForcedMode mode) {
+    if (mode == forcedMode) return;
+    forcedMode = mode;
+    ledConfigChanged();
+}
 
 // 获取强制模式
 ForcedMode getForcedMode() { return forcedMode; }
@@ -53,126 +163,111 @@ String getForcedModeText(ForcedMode mode) {
     }
 }
 
+// 把配置里的颜色顺序转换成 NeoPixel 类型，未知值按 WS2812 的 GRB 处理
+static neoPixelType colorOrderType(const char* order) {
+    if (strcmp(order, "RGB") == 0) return NEO_RGB;
+    if (strcmp(order, "RBG") == 0) return NEO_RBG;
+    if (strcmp(order, "BRG") == 0) return NEO_BRG;
+    if (strcmp(order, "BGR") == 0) return NEO_BGR;
+    if (strcmp(order, "GBR") == 0) return NEO_GBR;
+    return NEO_GRB;
+}
+
+// 按灯带长度一次性分配缓冲区，渲染过程中不再申请内存
+static bool allocateFrameBuffers(uint16_t count) {
+    strip.updateLength(count);
+    return compositor.begin(count) && strip.numPixels() == count;
+}
+
 // 初始化 LED 条
 void setupLED() {
+    if (!allocateFrameBuffers(ledCount)) {
+        appendLog(String("LED 缓冲区分配失败（") + ledCount + " 颗），回退到默认长度");
+        ledCount = DEFAULT_LED_COUNT;
+        if (!allocateFrameBuffers(ledCount)) {
+            // 连默认长度都分配不了时不输出灯效，合成器长度为 0，渲染任务也不会启动
+            compositor.begin(0);
+            appendLog(F("LED 缓冲区分配失败，灯效已停用"));
+            return;
+        }
+    }
+    strip.updateType(colorOrderType(ledColorOrder) + NEO_KHZ800);
+    strip.setPin(ledPin);
+    // 灯带自身亮度保持默认的 255，亮度在写像素时一次性乘上，避免 setBrightness 反复有损地缩放缓冲区
+    compositor.setSink(&neoPixelSink);
     strip.begin();
-    strip.setBrightness(globalBrightness);
     strip.show();
-    appendLog("LED 初始化完成");
+    appendLog(String("LED 初始化完成：") + ledCount + " 颗，引脚 " + ledPin + "，" + ledColorOrder);
+}
+
+// 当前画面是否随时间变化，决定帧率
+static uint8_t targetFps() {
+    if (testRequested || compositor.animated()) return ANIMATED_FPS;
+    return STATIC_FPS;
 }
 
-// 更新 LED 显示
+// 帧调度：到了当前灯效的帧间隔，或有新状态需要立即显示时才合成
 void updateLED() {
-    strip.clear();
-    if (testingLed) {
-        strip.setPixelColor(testLedIndex, 0xFFFFFF);
-        strip.show();
-        testLedIndex = (testLedIndex + 1) % LED_COUNT;
-        if (testLedIndex == 0) testingLed = false;
-        return;
+    unsigned long now = millis();
+    if (!frameDue && now - lastFrameAt < 1000UL / targetFps()) return;
+    frameDue = false;
+    lastFrameAt = now;
+    renderLedFrame(now);
+}
+
+// 渲染任务：按动画帧周期醒来，收到通知时提前醒来
+static void ledRenderTask(void*) {
+    const TickType_t period = pdMS_TO_TICKS(1000 / ANIMATED_FPS);
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, period);
+        updateLED();
     }
+}
 
-    if (forcedMode != NONE) {
-        switch (forcedMode) {
-            case PROGRESS:
-                for (int i = 0; i < LED_COUNT * printPercent / 100; i++) {
-                    strip.setPixelColor(i, progressBarColor);
-                }
-                strip.setBrightness(globalBrightness * progressBarBrightnessRatio);
-                break;
-            case STANDBY:
-                if (strcmp(standbyMode, "breathing") == 0) {
-                    uint8_t brightness = (sin(millis() / 1000.0) * 127.5 + 127.5) * standbyBrightnessRatio;
-                    strip.fill(standbyBreathingColor, 0, LED_COUNT);
-                    strip.setBrightness(brightness);
-                } else {
-                    strip.fill(standbyBreathingColor, 0, LED_COUNT);
-                    strip.setBrightness(globalBrightness * standbyBrightnessRatio);
-                }
-                break;
-            case AP_MODE_F:
-                strip.fill(0x0000FF, 0, LED_COUNT);
-                strip.setBrightness(globalBrightness);
-                break;
-            case CONNECTING_WIFI_F:
-                strip.fill(0xFFFF00, 0, LED_COUNT);
-                strip.setBrightness(globalBrightness);
-                break;
-            case CONNECTED_WIFI_F:
-                strip.fill(0x00FF00, 0, LED_COUNT);
-                strip.setBrightness(globalBrightness);
-                break;
-            case CONNECTING_PRINTER_F:
-                strip.fill(0xFF00FF, 0, LED_COUNT);
-                strip.setBrightness(globalBrightness);
-                break;
-            case CONNECTED_PRINTER_F:
-                strip.fill(0x00FFFF, 0, LED_COUNT);
-                strip.setBrightness(globalBrightness);
-                break;
-            case PRINTING_F:
-                strip.fill(0xFF0000, 0, LED_COUNT);
-                strip.setBrightness(globalBrightness);
-                break;
-            case FAILED_F:
-                strip.fill(0xFF0000, 0, LED_COUNT);
-                strip.setBrightness(globalBrightness);
-                break;
-            default:
-                break;
-        }
-    } else {
-        switch (currentState) {
-            case AP_MODE:
-                strip.fill(0x0000FF, 0, LED_COUNT);
-                strip.setBrightness(globalBrightness);
-                break;
-            case CONNECTING_WIFI:
-                strip.fill(0xFFFF00, 0, LED_COUNT);
-                strip.setBrightness(globalBrightness);
-                break;
-            case CONNECTED_WIFI:
-                strip.fill(0x00FF00, 0, LED_COUNT);
-                strip.setBrightness(globalBrightness);
-                break;
-            case CONNECTING_PRINTER:
-                strip.fill(0xFF00FF, 0, LED_COUNT);
-                strip.setBrightness(globalBrightness);
-                break;
-            case CONNECTED_PRINTER:
-                strip.fill(0x00FFFF, 0, LED_COUNT);
-                strip.setBrightness(globalBrightness);
-                break;
-            case PRINTING:
-                for (int i = 0; i < LED_COUNT * printPercent / 100; i++) {
-                    strip.setPixelColor(i, progressBarColor);
-                }
-                strip.setBrightness(globalBrightness * progressBarBrightnessRatio);
-                break;
-            case FAILED:
-                strip.fill(0xFF0000, 0, LED_COUNT);
-                strip.setBrightness(globalBrightness);
-                break;
-        }
+void startLedTask() {
+    if (ledTaskHandle || compositor.length() == 0) return;
+    publishLedSnapshot();   // 第一帧就用上已加载的配置
+    if (xTaskCreate(ledRenderTask, "led_render", LED_TASK_STACK, nullptr, LED_TASK_PRIORITY, &ledTaskHandle) != pdPASS) {
+        ledTaskHandle = nullptr;
+        appendLog("LED 渲染任务创建失败");
     }
+}
 
-    if (overlayMarquee) {
-        static int marqueePos = 0;
-        strip.setPixelColor(marqueePos, 0xFFFFFF);
-        marqueePos = (marqueePos + 1) % LED_COUNT;
+// 按给定时间合成并输出一帧，不经过帧调度；时间由调用方提供，便于按固定时钟回放
+void renderLedFrame(unsigned long now) {
+    if (compositor.length() == 0) return;
+    uint32_t startedAt = micros();
+    portENTER_CRITICAL(&snapshotMux);
+    frameSnapshot = publishedSnapshot;
+    portEXIT_CRITICAL(&snapshotMux);
+    if (testRequested) {
+        testRequested = false;
+        compositor.startTest();
     }
+    compositor.render(frameSnapshot, now);
+    lastRenderMicros = micros() - startedAt;
+    // 画面未变时灯带上已经是最新状态，同样算作完成
+    latencyFrameShown();
+}
 
-    strip.show();
+// 把 LED 状态直接写入调用方的 JSON 对象
+void fillLedStatus(JsonObject out) {
+    out["testingLed"] = compositor.testing();
+    out["testLedIndex"] = compositor.testIndex();
+    out["currentState"] = getStateText(currentState);
+    out["forcedMode"] = getForcedModeText(forcedMode);
+    out["brightness"] = compositor.brightness();
+    out["framesShown"] = compositor.framesShown();
+    out["framesSkipped"] = compositor.framesSkipped();
+    out["renderUs"] = lastRenderMicros;
+    out["progressSource"] = progressSource;
+    out["progress"] = compositor.shownProgressQ8(0) / 256.0;   // 主打印机分段当前显示的进度
 }
 
 // 获取 LED 状态
 String getLedStatus() {
     StaticJsonDocument<256> doc;
-    doc["testingLed"] = testingLed;
-    doc["testLedIndex"] = testLedIndex;
-    doc["currentState"] = getStateText(currentState);
-    doc["forcedMode"] = getForcedModeText(forcedMode);
-    doc["brightness"] = strip.getBrightness();
+    fillLedStatus(doc.to<JsonObject>());
     String output;
     serializeJson(doc, output);
     return output;
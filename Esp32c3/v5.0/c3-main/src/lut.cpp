@@ -0,0 +1,51 @@
+#include "lut.h"
+
+// constexpr 函数只用单条 return，兼容 C++11 工具链，表在编译期展开
+constexpr double LUT_HALF_PI = 1.5707963267948966;
+
+// sin 的泰勒展开，在 0 到 π/2 内误差小于 1e-5
+constexpr double lutSin(double x) {
+    return x - x * x * x / 6 + x * x * x * x * x / 120 - x * x * x * x * x * x * x / 5040 +
+           x * x * x * x * x * x * x * x * x / 362880;
+}
+
+// 牛顿迭代求五次方根，用于 x^2.2 = x^2 * x^0.2
+constexpr double lutRoot5(double x, double g, int n) {
+    return n == 0 ? g : lutRoot5(x, (4 * g + x / (g * g * g * g)) / 5, n - 1);
+}
+
+constexpr uint8_t lutGamma(int i) {
+    return i == 0 ? 0 : (uint8_t)(255.0 * (i / 255.0) * (i / 255.0) * lutRoot5(i / 255.0, 1.0, 24) + 0.5);
+}
+
+// 四分之一周期正弦，幅度 0-127
+constexpr uint8_t lutQuarterSine(int i) {
+    return (uint8_t)(127.0 * lutSin(i * LUT_HALF_PI / 64) + 0.5);
+}
+
+// HSV 色环：每 43 个 hue 一段，段内线性过渡，存表前做 gamma 校正
+constexpr uint32_t lutPack(int r, int g, int b) {
+    return ((uint32_t)lutGamma(r) << 16) | ((uint32_t)lutGamma(g) << 8) | lutGamma(b);
+}
+
+constexpr uint32_t lutRainbowSection(int section, int intensity) {
+    return section == 0 ? lutPack(255, intensity, 0)
+           : section == 1 ? lutPack(255 - intensity, 255, 0)
+           : section == 2 ? lutPack(0, 255, intensity)
+           : section == 3 ? lutPack(0, 255 - intensity, 255)
+           : section == 4 ? lutPack(intensity, 0, 255)
+           : lutPack(255, 0, 255 - intensity);
+}
+
+constexpr uint32_t lutRainbow(int hue) {
+    return lutRainbowSection(hue / 43, (hue % 43) * 6);
+}
+
+#define LUT_R4(f, i) f(i), f(i + 1), f(i + 2), f(i + 3)
+#define LUT_R16(f, i) LUT_R4(f, i), LUT_R4(f, i + 4), LUT_R4(f, i + 8), LUT_R4(f, i + 12)
+#define LUT_R64(f, i) LUT_R16(f, i), LUT_R16(f, i + 16), LUT_R16(f, i + 32), LUT_R16(f, i + 48)
+#define LUT_R256(f) LUT_R64(f, 0), LUT_R64(f, 64), LUT_R64(f, 128), LUT_R64(f, 192)
+
+const uint32_t RAINBOW_LUT[256] PROGMEM = { LUT_R256(lutRainbow) };
+const uint8_t GAMMA_LUT[256] PROGMEM = { LUT_R256(lutGamma) };
+const uint8_t QUARTER_SINE_LUT[65] PROGMEM = { LUT_R64(lutQuarterSine, 0), lutQuarterSine(64) };
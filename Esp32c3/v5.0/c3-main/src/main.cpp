@@ -24,6 +24,7 @@ void setup() {
 
     loadConfig();
     setupLED();
+    setState(CONNECTING_WIFI);
 
     WiFiManager wifiManager;
     wifiManager.setConfigPortalTimeout(180);
@@ -32,16 +33,19 @@ void setup() {
         ESP.restart();
     }
     appendLog(String(F("WiFi 连接成功，IP: ")) + WiFi.localIP().toString());
+    setState(CONNECTED_WIFI);
 
     udp.begin(8888);
     setupMQTT();
     setupWebServer();
     setupBLE();
+    startLedTask();
 }
 
 // 主循环
 void loop() {
     updateMQTT();
-    updateLED();
+    publishLedSnapshot();
+    refreshStatusCache();
     updateBLE();
 }
\ No newline at end of file
@@ -2,61 +2,274 @@
 #include "config.h"
 #include "utils.h"
 #include "led.h"
+#include "printer.h"
+#include "latency.h"
 #include <WiFi.h>
+#include <WiFiClientSecure.h>
 #include <PubSubClient.h>
 #include <ArduinoJson.h>
 
-WiFiClient wifiClient;
-PubSubClient client(wifiClient);
-JsonDocument printerState;
+// 云端与打印机 Broker 都是 TLS 自签证书；局域网测试可切换到明文连接
+WiFiClientSecure secureClient;
+WiFiClient plainClient;
+static Client* mqttTransport = &secureClient;
+PubSubClient client(secureClient);
 
 static const char* MQTT_BROKER = "mqtt.bambulab.com";
 static const int MQTT_PORT = 8883;
+static const char* LAN_USERNAME = "bblp";
 static unsigned long lastPushall = 0;
 static const long PUSHALL_INTERVAL = 5000;
+// 每次 updateMQTT 最多连续接收的报告数；回调只把报告复制进队列，解析在接收完之后统一进行
+static const uint8_t INGEST_BATCH_MAX = 8;
 
-// MQTT 回调函数
+// 待解析的报告队列：负载依次追加到 reportArena，处理完一批后整体清空
+struct QueuedReport {
+    uint16_t offset;
+    uint16_t length;
+    uint16_t fields;     // scanReportFields 的结果
+    uint8_t slot;        // 打印机分段
+    uint32_t arrivedAt;  // 到达时间（微秒），用于延迟统计
+};
+static const uint8_t REPORT_QUEUE_DEPTH = 8;
+static const size_t REPORT_ARENA_SIZE = 4096;
+static QueuedReport reportQueue[REPORT_QUEUE_DEPTH];
+static uint8_t reportQueueCount = 0;
+static char reportArena[REPORT_ARENA_SIZE];
+static size_t reportArenaUsed = 0;
+static uint32_t reportsCoalesced = 0;   // 被后续报告完全覆盖、未解析就丢弃的报告数
+
+// 连接参数由 configureLink 按配置生成，重连时直接复用；配置变了才重新生成
+static char clientId[48];
+static char reportTopics[MAX_PRINTERS][48];
+static char pushallTopic[64];
+static const char* mqttUsername = "";
+static const char* mqttPassword = "";
+
+// 报告过滤器：只保留需要渲染的 print 字段，其余字段在解析时直接跳过
+static JsonDocument reportFilter;
+
+static void initReportFilter() {
+    if (!reportFilter.isNull()) return;
+    JsonObject print = reportFilter["print"].to<JsonObject>();
+    print["gcode_state"] = true;
+    print["mc_percent"] = true;
+    print["mc_remaining_time"] = true;
+    print["layer_num"] = true;
+    print["total_layer_num"] = true;
+    print["nozzle_temper"] = true;
+    print["bed_temper"] = true;
+    print["chamber_temper"] = true;
+    print["wifi_signal"] = true;
+    print["spd_lvl"] = true;
+}
+
+// 合并并解析队列中的报告。从新到旧扫描：某条报告的字段如果都会被同一台打印机更新的报告覆盖，
+// 就不解析直接丢弃；需要的报告再按到达顺序应用，保证每个字段最终取最新值
+static void processQueuedReports() {
+    uint16_t laterFields[MAX_PRINTERS] = { 0 };
+    uint8_t needed = 0;
+    for (int i = reportQueueCount - 1; i >= 0; i--) {
+        const QueuedReport& r = reportQueue[i];
+        if (r.fields & ~laterFields[r.slot]) needed |= 1 << i;
+        laterFields[r.slot] |= r.fields;
+    }
+    for (uint8_t i = 0; i < reportQueueCount; i++) {
+        const QueuedReport& r = reportQueue[i];
+        if (!(needed & (1 << i))) {
+            reportsCoalesced++;
+            continue;
+        }
+        latencyReportArrived(r.arrivedAt);
+        processMqttMessage(reportArena + r.offset, r.length, r.slot);
+    }
+    reportQueueCount = 0;
+    reportArenaUsed = 0;
+}
+
+// MQTT 回调函数：只扫描字段并把负载复制进队列，PubSubClient 的缓冲区在回调返回后会被复用
 void mqttCallback(char* topic, byte* payload, unsigned int length) {
-    String payloadStr((char*)payload, length);
-    appendLog("收到 MQTT 消息，主题: " + String(topic));
-    processMqttMessage(payloadStr.c_str(), length);
+    uint32_t arrivedAt = micros();
+    const char* report = reinterpret_cast<const char*>(payload);
+    // 不包含任何关心字段的报告直接丢弃，不做解析
+    uint16_t fields = scanReportFields(report, length);
+    if (fields == 0) return;
+    // 按主题找到对应的打印机分段
+    uint8_t slot = 0;
+    while (slot < segmentCount && strcmp(topic, reportTopics[slot]) != 0) slot++;
+    if (slot == segmentCount) return;
+
+    // 队列放不下时先把已有的报告处理掉；单条报告超过整个缓冲区时直接解析
+    if (reportQueueCount == REPORT_QUEUE_DEPTH || reportArenaUsed + length > REPORT_ARENA_SIZE) {
+        processQueuedReports();
+    }
+    if (length > REPORT_ARENA_SIZE) {
+        latencyReportArrived(arrivedAt);
+        processMqttMessage(report, length, slot);
+        return;
+    }
+    memcpy(reportArena + reportArenaUsed, report, length);
+    reportQueue[reportQueueCount++] = { (uint16_t)reportArenaUsed, (uint16_t)length, fields, slot, arrivedAt };
+    reportArenaUsed += length;
+}
+
+// 连接状态机：握手在独立任务中进行，主循环只轮询结果，不会被 TCP/TLS 超时卡住
+enum MqttLinkState : uint8_t { LINK_IDLE, LINK_BACKOFF, LINK_CONNECTING, LINK_ONLINE };
+static MqttLinkState linkState = LINK_IDLE;
+static volatile bool connectDone = false;
+static volatile bool connectOk = false;
+static unsigned long nextAttemptAt = 0;
+static uint32_t backoffMs = 0;
+static const uint32_t BACKOFF_MIN_MS = 1000;
+static const uint32_t BACKOFF_MAX_MS = 60000;
+static const uint32_t CONNECT_TASK_STACK = 8192;
+static volatile bool configPending = false;   // 其他任务改了连接配置，由主循环断开并重建连接
+
+// 连上打印机后，整体状态跟随主打印机的打印阶段
+static State onlineState() {
+    switch (gcodePhase(printer.gcodeState)) {
+        case PHASE_PRINTING: return PRINTING;
+        case PHASE_FAILED: return FAILED;
+        default: return CONNECTED_PRINTER;
+    }
+}
+
+static void mqttConnectTask(void*) {
+    connectOk = client.connect(clientId, mqttUsername, mqttPassword);
+    connectDone = true;
+    vTaskDelete(nullptr);
+}
+
+// 失败后退避：上限内翻倍，实际等待取 [backoff/2, backoff] 的随机值，避免多台设备同时重连
+static void scheduleRetry() {
+    backoffMs = backoffMs == 0 ? BACKOFF_MIN_MS : min(backoffMs * 2, BACKOFF_MAX_MS);
+    uint32_t wait = backoffMs / 2 + esp_random() % (backoffMs / 2 + 1);
+    nextAttemptAt = millis() + wait;
+    linkState = LINK_BACKOFF;
+    setState(CONNECTING_PRINTER);
+    appendLog("MQTT 连接失败，错误码: " + String(client.state()) + "，" + String(wait) + " ms 后重试");
+}
+
+static void startConnect() {
+    connectDone = false;
+    connectOk = false;
+    linkState = LINK_CONNECTING;
+    setState(CONNECTING_PRINTER);
+    if (xTaskCreate(mqttConnectTask, "mqtt_connect", CONNECT_TASK_STACK, nullptr, 1, nullptr) != pdPASS) {
+        scheduleRetry();
+    }
+}
+
+// 按当前配置设置 Broker，生成客户端 ID、订阅主题和登录凭据
+static void configureLink() {
+    parsePrinterSegments();
+    if (isLanMode()) {
+        mqttTransport = mqttTls ? static_cast<Client*>(&secureClient) : static_cast<Client*>(&plainClient);
+        client.setServer(printerHost, mqttPort);
+        appendLog("MQTT 局域网模式: " + String(printerHost) + ":" + String(mqttPort));
+    } else {
+        mqttTransport = &secureClient;
+        client.setServer(MQTT_BROKER, MQTT_PORT);
+    }
+    client.setClient(*mqttTransport);
+    snprintf(clientId, sizeof(clientId), "BambuLED-%s", deviceID);
+    for (uint8_t i = 0; i < segmentCount; i++) {
+        snprintf(reportTopics[i], sizeof(reportTopics[i]), "device/%s/report", segments[i].deviceID);
+    }
+    snprintf(pushallTopic, sizeof(pushallTopic), "device/%s/pushall", deviceID);
+    mqttUsername = isLanMode() ? LAN_USERNAME : uid;
+    mqttPassword = isLanMode() ? accessCode : accessToken;
+}
+
+// 应用运行中修改的连接配置：断开旧连接、丢弃旧打印机的报告，按新参数立即重连。
+// 握手任务还在使用 client 时先不动，等它结束后再处理
+static void applyConfigChange() {
+    if (!configPending || linkState == LINK_CONNECTING) return;
+    configPending = false;
+    if (client.connected()) client.disconnect();
+    reportQueueCount = 0;
+    reportArenaUsed = 0;
+    resetPrinters();
+    configureLink();
+    ledConfigChanged();
+    backoffMs = 0;
+    nextAttemptAt = millis();
+    linkState = isMqttConfigured() ? LINK_BACKOFF : LINK_IDLE;
+    appendLog(isMqttConfigured() ? "MQTT 配置已更新，重新连接" : "MQTT 配置已更新，但仍不完整");
+}
+
+// 连接配置被修改时调用（可在任意任务中），实际的断开和重连由 updateMQTT 完成
+void mqttConfigChanged() {
+    configPending = true;
+}
+
+// 推进连接状态机，仅在 LINK_ONLINE 时才允许访问 client
+static void updateLink() {
+    applyConfigChange();
+    switch (linkState) {
+        case LINK_IDLE:
+            // 启动时配置不完整，配置补齐后开始连接
+            if (isMqttConfigured() && WiFi.status() == WL_CONNECTED) {
+                configureLink();
+                startConnect();
+            }
+            break;
+        case LINK_BACKOFF:
+            if ((long)(millis() - nextAttemptAt) >= 0 && WiFi.status() == WL_CONNECTED) {
+                startConnect();
+            }
+            break;
+        case LINK_CONNECTING: {
+            if (!connectDone) break;
+            // 同一个会话订阅所有打印机的报告主题
+            bool subscribed = connectOk;
+            for (uint8_t i = 0; subscribed && i < segmentCount; i++) {
+                subscribed = client.subscribe(reportTopics[i]);
+            }
+            if (subscribed) {
+                linkState = LINK_ONLINE;
+                backoffMs = 0;
+                setState(onlineState());
+                appendLog("MQTT 连接成功，已订阅 " + String(segmentCount) + " 台打印机");
+            } else {
+                scheduleRetry();
+            }
+            break;
+        }
+        case LINK_ONLINE:
+            if (!client.connected()) {
+                appendLog("MQTT 连接断开");
+                scheduleRetry();
+            }
+            break;
+    }
 }
 
 // 初始化 MQTT
 void setupMQTT() {
-    client.setServer(MQTT_BROKER, MQTT_PORT);
+    initReportFilter();
+    resetPrinters();
+    secureClient.setInsecure();
     client.setCallback(mqttCallback);
-    if (strlen(uid) > 0 && strlen(accessToken) > 0 && strlen(deviceID) > 0) {
-        String clientId = String("BambuLED-") + deviceID;
-        String username = uid;
-        String password = accessToken;
-        if (client.connect(clientId.c_str(), username.c_str(), password.c_str())) {
-            appendLog("MQTT 连接成功");
-            String topic = String("device/") + deviceID + "/report";
-            client.subscribe(topic.c_str());
-        } else {
-            appendLog("MQTT 连接失败，错误码: " + String(client.state()));
-        }
-    } else {
-        appendLog("MQTT 配置缺失，跳过连接");
+    configureLink();
+    if (!isMqttConfigured()) {
+        appendLog("MQTT 配置缺失，等待配置后再连接");
+        return;
     }
+    startConnect();
 }
 
 // 更新 MQTT 状态
 void updateMQTT() {
-    if (!client.connected()) {
-        if (strlen(uid) > 0 && strlen(accessToken) > 0 && strlen(deviceID) > 0) {
-            String clientId = String("BambuLED-") + deviceID;
-            String username = uid;
-            String password = accessToken;
-            if (client.connect(clientId.c_str(), username.c_str(), password.c_str())) {
-                appendLog("MQTT 重新连接成功");
-                String topic = String("device/") + deviceID + "/report";
-                client.subscribe(topic.c_str());
-            }
-        }
-    }
+    updateLink();
+    if (linkState != LINK_ONLINE) return;
+
     client.loop();
+    // 报告积压时在同一轮内全部收进队列（有上限），再一次性合并，过期的中间报告不会被解析
+    for (uint8_t i = 1; i < INGEST_BATCH_MAX && client.connected() && mqttTransport->available() > 0; i++) {
+        client.loop();
+    }
+    if (reportQueueCount > 0) processQueuedReports();
 
     if (millis() - lastPushall > (customPushallInterval > 0 ? customPushallInterval : PUSHALL_INTERVAL)) {
         sendPushall();
@@ -64,54 +277,68 @@ void updateMQTT() {
     }
 }
 
+// serializeJson 逐字节写入，攒满一块再交给 client，避免每个字节单独成为一个 TLS 记录
+class PublishWriter : public Print {
+public:
+    explicit PublishWriter(Print& out) : out_(out) {}
+    size_t write(uint8_t c) override {
+        buf_[len_++] = c;
+        if (len_ == sizeof(buf_)) flush();
+        return 1;
+    }
+    void flush() override {
+        if (len_ > 0) out_.write(buf_, len_);
+        len_ = 0;
+    }
+private:
+    Print& out_;
+    uint8_t buf_[128];
+    size_t len_ = 0;
+};
+
+// 先 measureJson 得到长度，再把文档直接流式写入 MQTT 连接，不生成中间 String
+static bool publishJson(const char* topic, JsonDocument& doc) {
+    size_t length = measureJson(doc);
+    if (!client.beginPublish(topic, length, false)) return false;
+    PublishWriter writer(client);
+    serializeJson(doc, writer);
+    writer.flush();
+    return client.endPublish();
+}
+
 // 发送 MQTT Pushall 消息
 void sendPushall() {
-    if (!client.connected()) return;
+    if (linkState != LINK_ONLINE || !client.connected()) return;
     JsonDocument doc;
-    doc["state"] = getStateText(getState());
-    doc["forcedMode"] = getForcedModeText(getForcedMode());
-    doc["printPercent"] = printPercent;
-    doc["gcodeState"] = gcodeState;
-    doc["remainingTime"] = remainingTime;
-    doc["layerNum"] = layerNum;
-    doc["totalLayerNum"] = totalLayerNum;
-    doc["nozzleTemper"] = nozzleTemper;
-    doc["bedTemper"] = bedTemper;
-    doc["chamberTemper"] = chamberTemper;
-    doc["wifiSignal"] = wifiSignal;
-    doc["spdLvl"] = spdLvl;
-    JsonDocument ledDoc;
-    deserializeJson(ledDoc, getLedStatus());
-    doc["led"] = ledDoc;
-    String output;
-    serializeJson(doc, output);
-    String topic = String("device/") + deviceID + "/pushall";
-    client.publish(topic.c_str(), output.c_str());
-    appendLog("发送 MQTT Pushall");
+    JsonObject root = doc.to<JsonObject>();
+    root["state"] = getStateText(getState());
+    root["forcedMode"] = getForcedModeText(getForcedMode());
+    fillPrinterStatus(root);
+    fillLedStatus(root["led"].to<JsonObject>());
+    root["reportsCoalesced"] = reportsCoalesced;
+    if (publishJson(pushallTopic, doc)) {
+        appendLog("发送 MQTT Pushall");
+    } else {
+        appendLog("MQTT Pushall 发送失败");
+    }
 }
 
-// 处理 MQTT 消息
-void processMqttMessage(const char *payload, unsigned int length) {
+// 处理 MQTT 消息（按过滤器解析，文档中只剩 print 下的已知字段）
+void processMqttMessage(const char *payload, unsigned int length, uint8_t slot) {
+    initReportFilter();
     JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, payload, length);
+    DeserializationError error = deserializeJson(doc, payload, length, DeserializationOption::Filter(reportFilter));
     if (error) {
         appendLog("MQTT 消息解析失败: " + String(error.code()));
         return;
     }
 
     if (!doc["print"].isNull()) {
-        JsonObject print = doc["print"];
-        if (!print["gcode_state"].isNull()) gcodeState = print["gcode_state"].as<String>();
-        if (!print["mc_percent"].isNull()) printPercent = print["mc_percent"].as<int>();
-        if (!print["mc_remaining_time"].isNull()) remainingTime = print["mc_remaining_time"].as<int>();
-        if (!print["layer_num"].isNull()) layerNum = print["layer_num"].as<int>();
-        if (!print["total_layer_num"].isNull()) totalLayerNum = print["total_layer_num"].as<int>();
-        if (!print["nozzle_temper"].isNull()) nozzleTemper = print["nozzle_temper"].as<float>();
-        if (!print["bed_temper"].isNull()) bedTemper = print["bed_temper"].as<float>();
-        if (!print["chamber_temper"].isNull()) chamberTemper = print["chamber_temper"].as<float>();
-        if (!print["wifi_signal"].isNull()) wifiSignal = print["wifi_signal"].as<String>();
-        if (!print["spd_lvl"].isNull()) spdLvl = print["spd_lvl"].as<int>();
-        printerState = doc;
-        appendLog("更新打印机状态");
+        uint16_t changed = mergePrinterReport(slot, doc["print"].as<JsonObjectConst>());
+        latencyReportMerged(changed != 0);
+        if (slot == 0 && (changed & PF_GCODE_STATE) && linkState == LINK_ONLINE) setState(onlineState());
+        if (changed) {
+            appendLog("更新打印机状态");
+        }
     }
 }
\ No newline at end of file
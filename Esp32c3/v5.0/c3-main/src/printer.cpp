@@ -0,0 +1,137 @@
+#include "printer.h"
+
+PrinterSnapshot printers[MAX_PRINTERS];
+PrinterSnapshot& printer = printers[0];
+static uint16_t pendingChanges[PC_COUNT][MAX_PRINTERS] = { { 0 } };   // 每个消费者按分段分别累积
+
+// 所有快照恢复为初始值
+void resetPrinters() {
+    for (PrinterSnapshot& p : printers) {
+        p = { "IDLE", "", 0, 0, 0, 1, 0, 0.0f, 0.0f, 0.0f, 0, 0 };
+    }
+}
+
+// 合并整数字段，值变化时置位
+template <typename T>
+static void mergeInt(JsonVariantConst value, T& field, uint16_t bit, uint16_t& changed) {
+    if (value.isNull()) return;
+    T v = value.as<T>();
+    if (v != field) {
+        field = v;
+        changed |= bit;
+    }
+}
+
+static void mergeFloat(JsonVariantConst value, float& field, uint16_t bit, uint16_t& changed) {
+    if (value.isNull()) return;
+    float v = value.as<float>();
+    if (v != field) {
+        field = v;
+        changed |= bit;
+    }
+}
+
+static void mergeText(JsonVariantConst value, char* field, size_t size, uint16_t bit, uint16_t& changed) {
+    if (value.isNull()) return;
+    const char* v = value.as<const char*>();
+    if (v == nullptr) return;
+    if (strncmp(v, field, size) != 0) {
+        strlcpy(field, v, size);
+        changed |= bit;
+    }
+}
+
+// 报告字段名与字段位的对应关系
+struct ReportKey {
+    const char* key;
+    uint16_t bit;
+};
+
+static const ReportKey REPORT_KEYS[] = {
+    { "\"gcode_state\"", PF_GCODE_STATE },
+    { "\"mc_percent\"", PF_PRINT_PERCENT },
+    { "\"mc_remaining_time\"", PF_REMAINING_TIME },
+    { "\"layer_num\"", PF_LAYER_NUM },
+    { "\"total_layer_num\"", PF_TOTAL_LAYER_NUM },
+    { "\"nozzle_temper\"", PF_NOZZLE_TEMPER },
+    { "\"bed_temper\"", PF_BED_TEMPER },
+    { "\"chamber_temper\"", PF_CHAMBER_TEMPER },
+    { "\"wifi_signal\"", PF_WIFI_SIGNAL },
+    { "\"spd_lvl\"", PF_SPD_LVL },
+};
+
+static bool containsKey(const char* payload, size_t length, const char* key) {
+    size_t keyLen = strlen(key);
+    const char* end = payload + length;
+    for (const char* p = payload; p + keyLen <= end; p++) {
+        p = static_cast<const char*>(memchr(p, '"', end - p));
+        if (p == nullptr || p + keyLen > end) return false;
+        if (memcmp(p, key, keyLen) == 0) return true;
+    }
+    return false;
+}
+
+// 不解析 JSON，只扫描报告中出现了哪些关心的字段
+uint16_t scanReportFields(const char* payload, size_t length) {
+    uint16_t fields = 0;
+    for (const ReportKey& k : REPORT_KEYS) {
+        if (containsKey(payload, length, k.key)) fields |= k.bit;
+    }
+    return fields;
+}
+
+// 合并某台打印机的一条 print 报告（可能是增量），只处理报告中出现的字段，返回变化位
+uint16_t mergePrinterReport(uint8_t slot, JsonObjectConst print) {
+    if (slot >= MAX_PRINTERS) return 0;
+    PrinterSnapshot& p = printers[slot];
+    uint16_t changed = 0;
+    mergeText(print["gcode_state"], p.gcodeState, sizeof(p.gcodeState), PF_GCODE_STATE, changed);
+    mergeInt(print["mc_percent"], p.printPercent, PF_PRINT_PERCENT, changed);
+    mergeInt(print["mc_remaining_time"], p.remainingTime, PF_REMAINING_TIME, changed);
+    mergeInt(print["layer_num"], p.layerNum, PF_LAYER_NUM, changed);
+    mergeInt(print["total_layer_num"], p.totalLayerNum, PF_TOTAL_LAYER_NUM, changed);
+    mergeFloat(print["nozzle_temper"], p.nozzleTemper, PF_NOZZLE_TEMPER, changed);
+    mergeFloat(print["bed_temper"], p.bedTemper, PF_BED_TEMPER, changed);
+    mergeFloat(print["chamber_temper"], p.chamberTemper, PF_CHAMBER_TEMPER, changed);
+    mergeText(print["wifi_signal"], p.wifiSignal, sizeof(p.wifiSignal), PF_WIFI_SIGNAL, changed);
+    mergeInt(print["spd_lvl"], p.spdLvl, PF_SPD_LVL, changed);
+
+    p.changed = changed;
+    if (changed) {
+        p.version++;
+        for (uint8_t i = 0; i < PC_COUNT; i++) {
+            pendingChanges[i][slot] |= changed;
+        }
+    }
+    return changed;
+}
+
+// 取出并清除某个消费者关心的未处理变化位（所有分段合并）
+uint16_t takePrinterChanges(PrinterConsumer consumer, uint16_t interest) {
+    uint16_t changes = 0;
+    for (uint8_t slot = 0; slot < MAX_PRINTERS; slot++) {
+        changes |= takePrinterSlotChanges(consumer, slot, interest);
+    }
+    return changes;
+}
+
+// 取出并清除某个消费者在单个分段上关心的未处理变化位
+uint16_t takePrinterSlotChanges(PrinterConsumer consumer, uint8_t slot, uint16_t interest) {
+    uint16_t changes = pendingChanges[consumer][slot] & interest;
+    pendingChanges[consumer][slot] &= ~interest;
+    return changes;
+}
+
+// 把快照写入调用方的 JSON 对象（pushall 与 BLE 状态共用的字段）
+void fillPrinterStatus(JsonObject out) {
+    out["printPercent"] = printer.printPercent;
+    out["gcodeState"] = printer.gcodeState;
+    out["remainingTime"] = printer.remainingTime;
+    out["layerNum"] = printer.layerNum;
+    out["totalLayerNum"] = printer.totalLayerNum;
+    out["nozzleTemper"] = printer.nozzleTemper;
+    out["bedTemper"] = printer.bedTemper;
+    out["chamberTemper"] = printer.chamberTemper;
+    out["wifiSignal"] = printer.wifiSignal;
+    out["spdLvl"] = printer.spdLvl;
+}
@@ -3,72 +3,287 @@
 #include "utils.h"
 #include "mqtt.h"
 #include "led.h"
+#include "printer.h"
+#include "latency.h"
 #include "ota.h"
 #include <ESPAsyncWebServer.h>
 #include <FS.h>
 #include <LittleFS.h>
 #include <ArduinoJson.h>
+#include <algorithm>
+#include <memory>
 
 AsyncWebServer server(80);
 
+// /events 推送：连接时发一份完整状态，之后只推送变化的字段；订阅数有上限，超出时回落到轮询 /status
+static AsyncEventSource events("/events");
+static const uint8_t SSE_MAX_CLIENTS = 4;
+
+// /status 的预序列化结果：主循环在状态变化时重建，请求处理只复制指针，
+// 并发的请求共用同一份字节，发送期间即使重建也不会被改写
+struct StatusBlob {
+    uint32_t version;
+    char etag[24];
+    String json;
+};
+static std::shared_ptr<const StatusBlob> statusBlob;
+static portMUX_TYPE statusMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t statusVersion = 0;
+static State statusState = AP_MODE;
+static ForcedMode statusForcedMode = NONE;
+static uint32_t statusBootNonce = 0;    // 写进 ETag，重启后版本号从头计数也不会误命中旧缓存
+// 延迟统计每条报告、每帧都会变化；/status 里的摘要最多按这个周期刷新，不让它每帧都使缓存失效
+static const uint32_t LATENCY_REFRESH_MS = 5000;
+static uint32_t statusLatencyAt = 0;
+static uint32_t statusLatencySamples = 0;
+
+// 页面在构建时压缩为 /index.html.gz（见 gzip_web.py），未压缩的 /index.html 只作为旧文件系统镜像的兜底
+static const char* INDEX_GZ_PATH = "/index.html.gz";
+static char indexEtag[24] = "";   // 为空表示没有压缩页面，不做缓存协商
+
+// 强 ETag 取 gzip 尾部的 CRC32 和原始长度，启动时读一次，之后的协商不再访问文件
+static void loadIndexEtag() {
+    File file = LittleFS.open(INDEX_GZ_PATH, "r");
+    if (!file) return;
+    uint8_t trailer[8];
+    if (file.size() > sizeof(trailer) && file.seek(file.size() - sizeof(trailer)) && file.read(trailer, sizeof(trailer)) == sizeof(trailer)) {
+        uint32_t crc = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | ((uint32_t)trailer[3] << 24);
+        uint32_t rawSize = trailer[4] | (trailer[5] << 8) | (trailer[6] << 16) | ((uint32_t)trailer[7] << 24);
+        snprintf(indexEtag, sizeof(indexEtag), "\"%08lx-%lx\"", (unsigned long)crc, (unsigned long)rawSize);
+    }
+    file.close();
+}
+
+static void addIndexCacheHeaders(AsyncWebServerResponse *response) {
+    response->addHeader("ETag", indexEtag);
+    response->addHeader("Cache-Control", "public, max-age=86400");
+}
+
+static void buildStatusJson(String& output) {
+    JsonDocument doc;
+    doc["status_text"] = getStateText(getState());
+    doc["forced_mode"] = getForcedModeText(getForcedMode());
+    doc["print_percent"] = printer.printPercent;
+    doc["gcode_state"] = printer.gcodeState;
+    doc["remaining_time"] = printer.remainingTime;
+    doc["layer_num"] = printer.layerNum;
+    doc["total_layer_num"] = printer.totalLayerNum;
+    doc["nozzle_temper"] = printer.nozzleTemper;
+    doc["bed_temper"] = printer.bedTemper;
+    doc["chamber_temper"] = printer.chamberTemper;
+    doc["wifi_signal"] = printer.wifiSignal;
+    doc["spd_lvl"] = printer.spdLvl;
+    JsonArray list = doc["printers"].to<JsonArray>();
+    for (uint8_t i = 0; i < segmentCount; i++) {
+        JsonObject item = list.add<JsonObject>();
+        item["device_id"] = segments[i].deviceID;
+        item["gcode_state"] = printers[i].gcodeState;
+        item["print_percent"] = printers[i].printPercent;
+    }
+    fillLatencyStats(doc["latency"].to<JsonObject>());
+    serializeJson(doc, output);
+}
+
+// 只序列化本次变化的字段：顶层字段只看主打印机的变化位，其他分段变化时只重发 printers 列表
+static void pushStatusDelta(const uint16_t* slotChanges, bool stateChanged, bool forcedChanged, bool latencyChanged, uint32_t version) {
+    if (events.count() == 0) return;
+    JsonDocument doc;
+    if (stateChanged) doc["status_text"] = getStateText(getState());
+    if (forcedChanged) doc["forced_mode"] = getForcedModeText(getForcedMode());
+    uint16_t changes = slotChanges[0];
+    if (changes & PF_PRINT_PERCENT) doc["print_percent"] = printer.printPercent;
+    if (changes & PF_GCODE_STATE) doc["gcode_state"] = printer.gcodeState;
+    if (changes & PF_REMAINING_TIME) doc["remaining_time"] = printer.remainingTime;
+    if (changes & PF_LAYER_NUM) doc["layer_num"] = printer.layerNum;
+    if (changes & PF_TOTAL_LAYER_NUM) doc["total_layer_num"] = printer.totalLayerNum;
+    if (changes & PF_NOZZLE_TEMPER) doc["nozzle_temper"] = printer.nozzleTemper;
+    if (changes & PF_BED_TEMPER) doc["bed_temper"] = printer.bedTemper;
+    if (changes & PF_CHAMBER_TEMPER) doc["chamber_temper"] = printer.chamberTemper;
+    if (changes & PF_WIFI_SIGNAL) doc["wifi_signal"] = printer.wifiSignal;
+    if (changes & PF_SPD_LVL) doc["spd_lvl"] = printer.spdLvl;
+    bool listChanged = false;
+    for (uint8_t i = 0; i < segmentCount; i++) {
+        if (slotChanges[i] & (PF_GCODE_STATE | PF_PRINT_PERCENT)) listChanged = true;
+    }
+    if (listChanged && segmentCount > 1) {
+        JsonArray list = doc["printers"].to<JsonArray>();
+        for (uint8_t i = 0; i < segmentCount; i++) {
+            JsonObject item = list.add<JsonObject>();
+            item["device_id"] = segments[i].deviceID;
+            item["gcode_state"] = printers[i].gcodeState;
+            item["print_percent"] = printers[i].printPercent;
+        }
+    }
+    if (latencyChanged) fillLatencyStats(doc["latency"].to<JsonObject>());
+    if (doc.isNull()) return;
+    String payload;
+    serializeJson(doc, payload);
+    events.send(payload.c_str(), "delta", version);
+}
+
+static std::shared_ptr<const StatusBlob> currentStatus() {
+    portENTER_CRITICAL(&statusMux);
+    std::shared_ptr<const StatusBlob> blob = statusBlob;
+    portEXIT_CRITICAL(&statusMux);
+    return blob;
+}
+
+// 主循环调用：打印机快照或灯效状态有变化时重新序列化 /status，否则什么也不做
+void refreshStatusCache() {
+    uint16_t slotChanges[MAX_PRINTERS];
+    uint16_t changes = 0;
+    for (uint8_t i = 0; i < MAX_PRINTERS; i++) {
+        slotChanges[i] = takePrinterSlotChanges(PC_WEB, i, PF_ALL);
+        changes |= slotChanges[i];
+    }
+    State state = getState();
+    ForcedMode forced = getForcedMode();
+    uint32_t now = millis();
+    uint32_t latencySamples = latencySampleCount();
+    bool latencyDue = latencySamples != statusLatencySamples && now - statusLatencyAt >= LATENCY_REFRESH_MS;
+    if (statusBlob && changes == 0 && state == statusState && forced == statusForcedMode && !latencyDue) return;
+    if (statusBootNonce == 0) statusBootNonce = esp_random() | 1;
+
+    std::shared_ptr<StatusBlob> next = std::make_shared<StatusBlob>();
+    next->version = ++statusVersion;
+    snprintf(next->etag, sizeof(next->etag), "\"%08lx-%lu\"", (unsigned long)statusBootNonce, (unsigned long)next->version);
+    buildStatusJson(next->json);
+    bool stateChanged = state != statusState;
+    bool forcedChanged = forced != statusForcedMode;
+    bool latencyChanged = latencySamples != statusLatencySamples;   // 因其他字段重建时摘要也会更新
+    statusState = state;
+    statusForcedMode = forced;
+    statusLatencyAt = now;
+    statusLatencySamples = latencySamples;
+
+    std::shared_ptr<const StatusBlob> previous = next;
+    portENTER_CRITICAL(&statusMux);
+    statusBlob.swap(previous);
+    portEXIT_CRITICAL(&statusMux);
+    // 旧快照在临界区外释放；仍在发送它的请求持有自己的引用
+    pushStatusDelta(slotChanges, stateChanged, forcedChanged, latencyChanged, next->version);
+}
+
 void setupWebServer() {
     if (!LittleFS.begin()) {
         appendLog(F("LittleFS 挂载失败"));
         return;
     }
+    loadIndexEtag();
 
     server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
-        request->send(LittleFS, "/index.html", "text/html");
+        if (indexEtag[0] == '\0') {
+            request->send(LittleFS, "/index.html", "text/html");
+            return;
+        }
+        // 浏览器缓存的版本仍然有效时直接回 304，不打开文件
+        if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == indexEtag) {
+            AsyncWebServerResponse *response = request->beginResponse(304);
+            addIndexCacheHeaders(response);
+            request->send(response);
+            return;
+        }
+        AsyncWebServerResponse *response = request->beginResponse(LittleFS, INDEX_GZ_PATH, "text/html");
+        response->addHeader("Content-Encoding", "gzip");
+        addIndexCacheHeaders(response);
+        request->send(response);
     });
 
     server.on("/status", HTTP_GET, [](AsyncWebServerRequest *request) {
-        StaticJsonDocument<384> doc; // 减少 JSON 缓冲区
-        doc["status_text"] = getStateText(getState());
-        doc["forced_mode"] = getForcedModeText(getForcedMode());
-        doc["print_percent"] = printPercent;
-        doc["gcode_state"] = gcodeState;
-        doc["remaining_time"] = remainingTime;
-        doc["layer_num"] = layerNum;
-        doc["total_layer_num"] = totalLayerNum;
-        doc["nozzle_temper"] = nozzleTemper;
-        doc["bed_temper"] = bedTemper;
-        doc["chamber_temper"] = chamberTemper;
-        doc["wifi_signal"] = wifiSignal;
-        doc["spd_lvl"] = spdLvl;
+        std::shared_ptr<const StatusBlob> blob = currentStatus();
+        if (!blob) {
+            request->send(503, "text/plain", "状态尚未就绪");
+            return;
+        }
+        if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == blob->etag) {
+            AsyncWebServerResponse *response = request->beginResponse(304);
+            response->addHeader("ETag", blob->etag);
+            request->send(response);
+            return;
+        }
+        // 回调持有 blob 的引用，响应发完之前这份字节一直有效
+        AsyncWebServerResponse *response = request->beginResponse("application/json", blob->json.length(),
+            [blob](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+                size_t length = std::min(maxLen, (size_t)(blob->json.length() - index));
+                memcpy(buffer, blob->json.c_str() + index, length);
+                return length;
+            });
+        response->addHeader("ETag", blob->etag);
+        response->addHeader("Cache-Control", "no-cache");
+        request->send(response);
+    });
+
+    events.setFilter([](AsyncWebServerRequest *request) {
+        return events.count() < SSE_MAX_CLIENTS;
+    });
+    events.onConnect([](AsyncEventSourceClient *client) {
+        std::shared_ptr<const StatusBlob> blob = currentStatus();
+        if (blob) client->send(blob->json.c_str(), "status", blob->version);
+    });
+    server.addHandler(&events);
+
+    // /status 里的延迟摘要按周期刷新；这里每次请求都现算，调试时看最新的统计
+    server.on("/latency", HTTP_GET, [](AsyncWebServerRequest *request) {
+        JsonDocument doc;
+        fillLatencyStats(doc.to<JsonObject>());
         String output;
         serializeJson(doc, output);
         request->send(200, "application/json", output);
     });
 
     server.on("/getConfig", HTTP_GET, [](AsyncWebServerRequest *request) {
-        StaticJsonDocument<384> doc; // 减少 JSON 缓冲区
+        StaticJsonDocument<512> doc;
         doc["uid"] = uid;
         doc["accessToken"] = accessToken;
         doc["deviceID"] = deviceID;
+        doc["mqttMode"] = mqttMode;
+        doc["printerHost"] = printerHost;
+        doc["accessCode"] = accessCode;
+        doc["mqttPort"] = mqttPort;
+        doc["mqttTls"] = mqttTls;
         doc["globalBrightness"] = globalBrightness;
+        doc["ledCount"] = ledCount;
+        doc["ledPin"] = ledPin;
+        doc["ledColorOrder"] = ledColorOrder;
         doc["standbyMode"] = standbyMode;
+        doc["progressSource"] = progressSource;
         doc["progressBarColor"] = progressBarColor;
         doc["standbyBreathingColor"] = standbyBreathingColor;
         doc["progressBarBrightnessRatio"] = progressBarBrightnessRatio;
         doc["standbyBrightnessRatio"] = standbyBrightnessRatio;
         doc["customPushallInterval"] = customPushallInterval;
         doc["overlayMarquee"] = overlayMarquee;
+        doc["printerSegments"] = printerSegments;
         String output;
         serializeJson(doc, output);
         request->send(200, "application/json", output);
     });
 
     server.on("/config", HTTP_POST, [](AsyncWebServerRequest *request) {
-        if (!request->hasParam("uid", true) || !request->hasParam("accessToken", true) || !request->hasParam("deviceID", true)) {
+        bool lan = request->hasParam("mqttMode", true) && request->getParam("mqttMode", true)->value() == "lan";
+        bool missing = !request->hasParam("deviceID", true);
+        if (lan) {
+            missing = missing || !request->hasParam("printerHost", true) || !request->hasParam("accessCode", true);
+        } else {
+            missing = missing || !request->hasParam("uid", true) || !request->hasParam("accessToken", true);
+        }
+        if (missing) {
             request->send(400, "text/plain", "缺少必要参数");
             return;
         }
 
-        strlcpy(uid, request->getParam("uid", true)->value().c_str(), sizeof(uid));
-        strlcpy(accessToken, request->getParam("accessToken", true)->value().c_str(), sizeof(accessToken));
+        strlcpy(mqttMode, lan ? "lan" : "cloud", sizeof(mqttMode));
+        strlcpy(uid, request->hasParam("uid", true) ? request->getParam("uid", true)->value().c_str() : "", sizeof(uid));
+        strlcpy(accessToken, request->hasParam("accessToken", true) ? request->getParam("accessToken", true)->value().c_str() : "", sizeof(accessToken));
         strlcpy(deviceID, request->getParam("deviceID", true)->value().c_str(), sizeof(deviceID));
+        strlcpy(printerHost, request->hasParam("printerHost", true) ? request->getParam("printerHost", true)->value().c_str() : "", sizeof(printerHost));
+        strlcpy(accessCode, request->hasParam("accessCode", true) ? request->getParam("accessCode", true)->value().c_str() : "", sizeof(accessCode));
+        mqttPort = request->hasParam("mqttPort", true) ? request->getParam("mqttPort", true)->value().toInt() : 8883;
+        if (mqttPort <= 0 || mqttPort > 65535) mqttPort = 8883;
+        mqttTls = !lan || request->hasParam("mqttTls", true);
         globalBrightness = request->hasParam("globalBrightness", true) ? request->getParam("globalBrightness", true)->value().toInt() : 255;
         strlcpy(standbyMode, request->hasParam("standbyMode", true) ? request->getParam("standbyMode", true)->value().c_str() : "breathing", sizeof(standbyMode));
+        strlcpy(progressSource, request->hasParam("progressSource", true) ? request->getParam("progressSource", true)->value().c_str() : "auto", sizeof(progressSource));
         String progressColor = request->hasParam("progressBarColor", true) ? request->getParam("progressBarColor", true)->value() : "FFFFFF";
         progressBarColor = strtoul(progressColor.c_str(), nullptr, 16);
         String standbyColor = request->hasParam("standbyBreathingColor", true) ? request->getParam("standbyBreathingColor", true)->value() : "FFFFFF";
@@ -77,6 +292,11 @@ void setupWebServer() {
         standbyBrightnessRatio = request->hasParam("standbyBrightnessRatio", true) ? request->getParam("standbyBrightnessRatio", true)->value().toFloat() : 1.0;
         customPushallInterval = request->hasParam("customPushallInterval", true) ? request->getParam("customPushallInterval", true)->value().toInt() : 10000;
         overlayMarquee = request->hasParam("overlayMarquee", true);
+        // 灯带参数在下次启动时生效，保存后设备会重启
+        if (request->hasParam("ledCount", true)) ledCount = constrain(request->getParam("ledCount", true)->value().toInt(), 1, MAX_LED_COUNT);
+        if (request->hasParam("ledPin", true)) ledPin = constrain(request->getParam("ledPin", true)->value().toInt(), 0, 21);
+        if (request->hasParam("ledColorOrder", true)) strlcpy(ledColorOrder, request->getParam("ledColorOrder", true)->value().c_str(), sizeof(ledColorOrder));
+        strlcpy(printerSegments, request->hasParam("printerSegments", true) ? request->getParam("printerSegments", true)->value().c_str() : "", sizeof(printerSegments));
 
         saveConfig();
         appendLog(F("Web 配置更新成功"));
@@ -106,8 +326,7 @@ void setupWebServer() {
     });
 
     server.on("/testLed", HTTP_POST, [](AsyncWebServerRequest *request) {
-        testingLed = true;
-        testLedIndex = 0;
+        startLedTest();
         appendLog(F("Web 启动 LED 测试"));
         request->send(200, "text/plain", "LED 测试完成");
     });
@@ -0,0 +1,77 @@
+// 合成耗时报告：按固定时钟连续合成，输出每帧平均纳秒数。
+// 主机上的数值只用于改动前后对比，不代表 ESP32-C3 上的绝对耗时。用法：led_bench [帧数]
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include "scripted_driver.h"
+
+// 只计数的输出端，排除记录帧本身的开销
+class CountingSink : public PixelSink {
+public:
+    uint32_t frames = 0;
+    void writeFrame(const uint32_t*, uint16_t) override { frames++; }
+};
+
+// 单台打印机按时间推算进度
+static void progressCase(ScriptedDriver& d) {
+    d.singlePrinter();
+    d.snap.phase[0] = PHASE_PRINTING;
+    d.snap.running[0] = true;
+    d.snap.printPercent[0] = 40;
+    d.snap.totalLayerNum[0] = 200;
+    d.snap.layerNum[0] = 80;
+    d.snap.remainingTime[0] = 30;
+}
+
+// 待机呼吸叠加跑马灯，每帧整条灯带都要重算
+static void breathingCase(ScriptedDriver& d) {
+    d.singlePrinter();
+    d.snap.standbyBreathing = true;
+    d.snap.overlayMarquee = true;
+}
+
+// 八台打印机平分灯带，打印、失败、空闲交替
+static void multiCase(ScriptedDriver& d) {
+    uint16_t length = d.compositor.length() / MAX_PRINTERS;
+    d.snap.segmentCount = MAX_PRINTERS;
+    d.snap.standbyBreathing = true;
+    for (uint8_t s = 0; s < MAX_PRINTERS; s++) {
+        d.snap.segments[s].start = s * length;
+        d.snap.segments[s].length = length;
+        d.snap.phase[s] = (PrinterPhase)(s % 3 == 0 ? PHASE_PRINTING : s % 3 == 1 ? PHASE_FAILED : PHASE_IDLE);
+        d.snap.running[s] = true;
+        d.snap.printPercent[s] = 10 * s;
+        d.snap.remainingTime[s] = 20;
+    }
+}
+
+struct BenchCase {
+    const char* name;
+    void (*setup)(ScriptedDriver& d);
+};
+
+static const BenchCase CASES[] = {
+    { "progress", progressCase },
+    { "breathing", breathingCase },
+    { "multi8", multiCase },
+};
+static const uint16_t LENGTHS[] = { 60, 300, 1024 };
+
+int main(int argc, char** argv) {
+    unsigned long frames = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000;
+    if (frames == 0) frames = 1;
+    printf("%-10s %6s %12s %10s %8s\n", "scene", "leds", "ns/frame", "ns/pixel", "shown");
+    for (const BenchCase& c : CASES) {
+        for (uint16_t length : LENGTHS) {
+            CountingSink sink;
+            ScriptedDriver d(length, &sink);
+            c.setup(d);
+            auto started = std::chrono::steady_clock::now();
+            uint32_t rendered = d.run(frames * 33, 33);
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count();
+            printf("%-10s %6u %12.0f %10.2f %8u\n", c.name, (unsigned)length, ns / rendered,
+                   ns / rendered / length, (unsigned)sink.frames);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,25 @@
+# 单文件固件（v4.2、v3.4）无法引用 lut.h，各自带一份查找表生成器的副本。
+# 比较 lut.cpp 与副本中从 LUT_HALF_PI 到 QUARTER_SINE_LUT 的代码，忽略注释和空白。
+# cmake -DCANONICAL=<lut.cpp> "-DCOPIES=<a.cpp;b.cpp>" -P check_lut_sync.cmake
+function(extract_lut_generator path out)
+  file(READ ${path} text)
+  string(FIND "${text}" "constexpr double LUT_HALF_PI" begin)
+  string(FIND "${text}" "QUARTER_SINE_LUT[65] PROGMEM" end)
+  if(begin EQUAL -1 OR end EQUAL -1)
+    message(FATAL_ERROR "${path}: 找不到查找表生成器")
+  endif()
+  math(EXPR length "${end} - ${begin}")
+  string(SUBSTRING "${text}" ${begin} ${length} block)
+  string(REGEX REPLACE "//[^\n]*" "" block "${block}")
+  string(REGEX REPLACE "[ \t\r\n]+" "" block "${block}")
+  set(${out} "${block}" PARENT_SCOPE)
+endfunction()
+
+extract_lut_generator(${CANONICAL} canonical)
+foreach(copy ${COPIES})
+  extract_lut_generator(${copy} block)
+  if(NOT block STREQUAL canonical)
+    message(FATAL_ERROR "${copy}: 查找表生成器与 ${CANONICAL} 不一致，请从 lut.cpp 重新同步")
+  endif()
+  message(STATUS "${copy}: 与 lut.cpp 一致")
+endforeach()
@@ -0,0 +1,77 @@
+// 金样比对：按脚本回放每个场景，把输出端收到的帧与 golden/ 下的文件逐行比较。
+// 用法：led_golden <golden 目录> [--update]，--update 用当前输出重写金样
+// 金样是拆分合成器之后录制的向前基线，不代表重构前的画面，见 README.md
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "scenarios.h"
+
+static std::string renderScenario(const Scenario& sc) {
+    ScriptedDriver d(sc.length);
+    sc.script(d);
+    d.run(sc.durationMs, sc.frameMs);
+    char header[96];
+    snprintf(header, sizeof(header), "# %s: %u leds, frame every %lu ms, changed frames only\n",
+             sc.name, (unsigned)sc.length, sc.frameMs);
+    return header + d.recorder.dump();
+}
+
+static bool readFile(const std::string& path, std::string& out) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    std::stringstream ss;
+    ss << in.rdbuf();
+    out = ss.str();
+    // 金样在 Windows 上检出时可能被转成 CRLF
+    out.erase(std::remove(out.begin(), out.end(), '\r'), out.end());
+    return true;
+}
+
+// 找到第一处不同的行，输出行号和两边内容
+static void reportMismatch(const std::string& expected, const std::string& actual) {
+    std::istringstream e(expected), a(actual);
+    std::string le, la;
+    for (int line = 1;; line++) {
+        bool he = (bool)std::getline(e, le);
+        bool ha = (bool)std::getline(a, la);
+        if (!he && !ha) return;
+        if (he != ha || le != la) {
+            printf("  line %d\n  expected: %s\n  actual:   %s\n", line, he ? le.c_str() : "<eof>", ha ? la.c_str() : "<eof>");
+            return;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <golden dir> [--update]\n", argv[0]);
+        return 2;
+    }
+    std::string dir = argv[1];
+    bool update = argc > 2 && std::string(argv[2]) == "--update";
+    int failures = 0;
+    for (size_t i = 0; i < SCENARIO_COUNT; i++) {
+        const Scenario& sc = SCENARIOS[i];
+        std::string path = dir + "/" + sc.name + ".txt";
+        std::string actual = renderScenario(sc);
+        if (update) {
+            std::ofstream(path, std::ios::binary) << actual;
+            printf("updated %s\n", path.c_str());
+            continue;
+        }
+        std::string expected;
+        if (!readFile(path, expected)) {
+            printf("FAIL %s: missing %s\n", sc.name, path.c_str());
+            failures++;
+        } else if (expected != actual) {
+            printf("FAIL %s\n", sc.name);
+            reportMismatch(expected, actual);
+            failures++;
+        } else {
+            printf("ok   %s\n", sc.name);
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,39 @@
+#ifndef RECORDING_SINK_H
+#define RECORDING_SINK_H
+#include <string>
+#include <vector>
+#include "pixel_sink.h"
+
+// 记录每一帧输出的输出端：保存输出时刻和完整像素，供金样比对
+class RecordingSink : public PixelSink {
+public:
+    struct Frame {
+        unsigned long at;
+        std::vector<uint32_t> pixels;
+    };
+
+    unsigned long now = 0;   // 由驱动在每帧合成前设置
+    std::vector<Frame> frames;
+
+    void writeFrame(const uint32_t* pixels, uint16_t count) override {
+        frames.push_back({ now, std::vector<uint32_t>(pixels, pixels + count) });
+    }
+
+    // 每帧一行：时刻（毫秒）后跟各像素的 RRGGBB
+    std::string dump() const {
+        std::string out;
+        char word[16];
+        for (const Frame& f : frames) {
+            snprintf(word, sizeof(word), "%lu", f.at);
+            out += word;
+            for (uint32_t p : f.pixels) {
+                snprintf(word, sizeof(word), " %06x", (unsigned)p);
+                out += word;
+            }
+            out += '\n';
+        }
+        return out;
+    }
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include "scenarios.h"
+
+// 设备启动过程：连上打印机之前整条灯带按设备状态着色，连上后空闲打印机显示待机色
+static void bootStates(ScriptedDriver& d) {
+    d.singlePrinter();
+    d.snap.state = AP_MODE;
+    d.at(200, [](ScriptedDriver& d) { d.snap.state = CONNECTING_WIFI; });
+    d.at(400, [](ScriptedDriver& d) { d.snap.state = CONNECTED_WIFI; });
+    d.at(600, [](ScriptedDriver& d) { d.snap.state = CONNECTING_PRINTER; });
+    d.at(800, [](ScriptedDriver& d) { d.snap.state = CONNECTED_PRINTER; });
+}
+
+// 按整数百分比显示进度，末尾灯珠按小数部分混合，进度亮度减半
+static void progressPercent(ScriptedDriver& d) {
+    d.singlePrinter();
+    d.snap.phase[0] = PHASE_PRINTING;
+    d.snap.running[0] = true;
+    d.snap.progressSource = PS_PERCENT;
+    d.snap.progressBrightness = 128;
+    d.at(100, [](ScriptedDriver& d) { d.snap.printPercent[0] = 25; });
+    d.at(200, [](ScriptedDriver& d) { d.snap.printPercent[0] = 37; });
+    d.at(300, [](ScriptedDriver& d) { d.snap.printPercent[0] = 100; });
+}
+
+// 按剩余时间推算进度：不越过下一个整数百分比，暂停期间停住，恢复后从新的报告重新锚定
+static void progressTime(ScriptedDriver& d) {
+    d.singlePrinter();
+    d.snap.phase[0] = PHASE_PRINTING;
+    d.snap.running[0] = true;
+    d.snap.progressSource = PS_TIME;
+    d.snap.printPercent[0] = 50;
+    d.snap.remainingTime[0] = 1;
+    d.at(1500, [](ScriptedDriver& d) {
+        d.snap.running[0] = false;
+        d.snap.anchorMs[0] = d.now();
+    });
+    d.at(2000, [](ScriptedDriver& d) {
+        d.snap.running[0] = true;
+        d.snap.printPercent[0] = 51;
+        d.snap.anchorMs[0] = d.now();
+    });
+}
+
+// 三台打印机各占一段：打印中显示进度，失败闪烁告警，空闲呼吸；跑马灯在每段内各自循环
+static void multiPrinter(ScriptedDriver& d) {
+    d.snap.state = PRINTING;
+    d.snap.segmentCount = 3;
+    for (uint8_t s = 0; s < 3; s++) {
+        d.snap.segments[s].start = s * 8;
+        d.snap.segments[s].length = 8;
+    }
+    d.snap.phase[0] = PHASE_PRINTING;
+    d.snap.running[0] = true;
+    d.snap.printPercent[0] = 50;
+    d.snap.progressSource = PS_PERCENT;
+    d.snap.phase[1] = PHASE_FAILED;
+    d.snap.phase[2] = PHASE_IDLE;
+    d.snap.standbyBreathing = true;
+    d.snap.standbyBrightness = 200;
+    d.snap.overlayMarquee = true;
+}
+
+// 强制模式：待机呼吸、告警和进度覆盖打印机自身的状态，取消后回到按打印机选场景
+static void forcedModes(ScriptedDriver& d) {
+    d.singlePrinter();
+    d.snap.standbyBreathing = true;
+    d.snap.printPercent[0] = 60;
+    d.snap.progressSource = PS_PERCENT;
+    d.snap.forcedMode = STANDBY;
+    d.at(300, [](ScriptedDriver& d) { d.snap.forcedMode = FAILED_F; });
+    d.at(1200, [](ScriptedDriver& d) { d.snap.forcedMode = PROGRESS; });
+    d.at(1500, [](ScriptedDriver& d) { d.snap.forcedMode = NONE; });
+}
+
+// 测试灯珠逐颗走完一圈后回到正常画面
+static void testLed(ScriptedDriver& d) {
+    d.singlePrinter();
+    d.snap.globalBrightness = 64;
+    d.at(0, [](ScriptedDriver& d) { d.compositor.startTest(); });
+}
+
+const Scenario SCENARIOS[] = {
+    { "boot_states", 12, 1000, 100, bootStates },
+    { "progress_percent", 10, 400, 50, progressPercent },
+    { "progress_time", 20, 3000, 100, progressTime },
+    { "multi_printer", 24, 1200, 100, multiPrinter },
+    { "forced_modes", 12, 1800, 100, forcedModes },
+    { "test_led", 6, 400, 33, testLed },
+};
+const size_t SCENARIO_COUNT = sizeof(SCENARIOS) / sizeof(SCENARIOS[0]);
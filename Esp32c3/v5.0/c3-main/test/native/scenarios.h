@@ -0,0 +1,18 @@
+#ifndef SCENARIOS_H
+#define SCENARIOS_H
+#include <stddef.h>
+#include "scripted_driver.h"
+
+// 金样场景：名字同时是 golden/ 下的文件名
+struct Scenario {
+    const char* name;
+    uint16_t length;           // 灯珠数
+    unsigned long durationMs;
+    unsigned long frameMs;     // 帧间隔
+    void (*script)(ScriptedDriver& d);
+};
+
+extern const Scenario SCENARIOS[];
+extern const size_t SCENARIO_COUNT;
+
+#endif
@@ -0,0 +1,41 @@
+#include "scripted_driver.h"
+#include <algorithm>
+
+ScriptedDriver::ScriptedDriver(uint16_t length, PixelSink* sink) : snap() {
+    compositor.begin(length);
+    compositor.setSink(sink ? sink : &recorder);
+    snap.state = CONNECTED_PRINTER;
+    snap.forcedMode = NONE;
+    snap.globalBrightness = 255;
+    snap.progressBrightness = 255;
+    snap.standbyBrightness = 255;
+    snap.progressBarColor = 0xFFFFFF;
+    snap.standbyColor = 0x0080FF;
+    snap.progressSource = PS_AUTO;
+}
+
+void ScriptedDriver::singlePrinter() {
+    snap.segmentCount = 1;
+    snap.segments[0].start = 0;
+    snap.segments[0].length = compositor.length();
+    snap.phase[0] = PHASE_IDLE;
+}
+
+void ScriptedDriver::at(unsigned long ms, Event event) {
+    script.push_back({ ms, event });
+    std::stable_sort(script.begin(), script.end(), [](const Scheduled& a, const Scheduled& b) { return a.at < b.at; });
+}
+
+uint32_t ScriptedDriver::run(unsigned long untilMs, unsigned long frameMs) {
+    uint32_t frames = 0;
+    size_t next = 0;
+    for (clock = 0; clock < untilMs; clock += frameMs) {
+        while (next < script.size() && script[next].at <= clock) {
+            script[next++].event(*this);
+        }
+        recorder.now = clock;
+        compositor.render(snap, clock);
+        frames++;
+    }
+    return frames;
+}
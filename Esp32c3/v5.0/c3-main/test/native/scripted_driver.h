@@ -0,0 +1,35 @@
+#ifndef SCRIPTED_DRIVER_H
+#define SCRIPTED_DRIVER_H
+#include <functional>
+#include <vector>
+#include "compositor.h"
+#include "recording_sink.h"
+
+// 固定时钟驱动：按帧间隔推进时间，每帧合成前先执行脚本里到期的事件，
+// 事件直接修改快照，相当于主循环发布了一份新快照。不指定输出端时帧记录在 recorder 里
+class ScriptedDriver {
+public:
+    typedef std::function<void(ScriptedDriver&)> Event;
+
+    LedSnapshot snap;
+    Compositor compositor;
+    RecordingSink recorder;
+
+    explicit ScriptedDriver(uint16_t length, PixelSink* sink = nullptr);
+    // 单台打印机占满整条灯带，连上打印机、待机常亮、亮度全开
+    void singlePrinter();
+    void at(unsigned long ms, Event event);
+    // 从 0 跑到 untilMs（不含），返回合成的帧数
+    uint32_t run(unsigned long untilMs, unsigned long frameMs);
+    unsigned long now() const { return clock; }
+
+private:
+    struct Scheduled {
+        unsigned long at;
+        Event event;
+    };
+    std::vector<Scheduled> script;
+    unsigned long clock = 0;
+};
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef ARDUINO_STUB_H
+#define ARDUINO_STUB_H
+// 主机编译用的最小 Arduino 头：合成器只用到整数类型、C 字符串和 constrain/min/max
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef PGMSPACE_STUB_H
+#define PGMSPACE_STUB_H
+// 主机上没有单独的 flash 地址空间，直接解引用
+#include <stdint.h>
+
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t*)(addr))
+
+#endif
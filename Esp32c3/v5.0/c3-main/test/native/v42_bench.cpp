@@ -0,0 +1,251 @@
+// v4.2 灯效渲染前后对比：before 是改用定点数之前（3400ce4）的浮点实现，从当时的 updateLED() 原样摘出，
+// 只把 LED_COUNT 换成灯珠数参数、把与灯效无关的分支去掉；Q8 实现直接包含 v4.2.cpp 使用的 v4.2_render.h，
+// 不另行复制。灯带用 HostStrip 模拟 Adafruit_NeoPixel 的亮度处理，show() 不计入。
+// 主机有 FPU，浮点版在这里的劣势比在 ESP32-C3（软浮点）上小得多，数值只用于前后对比。
+// 用法：v42_bench [帧数]
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "v4.2_render.h"
+
+#ifndef PI
+#define PI 3.1415926535897932384626433832795
+#endif
+
+// 与 Adafruit_NeoPixel 相同的亮度语义：setPixelColor 写入时按亮度缩放，getPixelColor 读出时反算，
+// setBrightness 改变时按比例重缩放整个缓冲区
+class HostStrip {
+public:
+    explicit HostStrip(uint16_t n) : pixels(n * 3u, 0), count(n) {}
+
+    static uint32_t Color(uint8_t r, uint8_t g, uint8_t b) { return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b; }
+    uint16_t numPixels() const { return count; }
+    void clear() { std::fill(pixels.begin(), pixels.end(), 0); }
+
+    void setBrightness(uint8_t b) {
+        uint8_t newBrightness = b + 1;
+        if (newBrightness == brightness) return;
+        uint8_t oldBrightness = brightness - 1;
+        uint16_t scale;
+        if (oldBrightness == 0) scale = 0;
+        else if (b == 255) scale = 65535 / oldBrightness;
+        else scale = (((uint16_t)newBrightness << 8) - 1) / oldBrightness;
+        for (uint8_t& c : pixels) c = (c * scale) >> 8;
+        brightness = newBrightness;
+    }
+
+    void setPixelColor(uint16_t n, uint32_t c) {
+        setPixelColor(n, (uint8_t)(c >> 16), (uint8_t)(c >> 8), (uint8_t)c);
+    }
+
+    void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b) {
+        if (n >= count) return;
+        if (brightness) {
+            r = (r * brightness) >> 8;
+            g = (g * brightness) >> 8;
+            b = (b * brightness) >> 8;
+        }
+        uint8_t* p = &pixels[n * 3u];
+        p[0] = r;
+        p[1] = g;
+        p[2] = b;
+    }
+
+    uint32_t getPixelColor(uint16_t n) const {
+        if (n >= count) return 0;
+        const uint8_t* p = &pixels[n * 3u];
+        if (!brightness) return Color(p[0], p[1], p[2]);
+        return Color((p[0] << 8) / brightness, (p[1] << 8) / brightness, (p[2] << 8) / brightness);
+    }
+
+private:
+    std::vector<uint8_t> pixels;
+    uint16_t count;
+    uint8_t brightness = 0;
+};
+
+enum Scene { SCENE_PROGRESS_MARQUEE, SCENE_BREATHING, SCENE_MARQUEE };
+
+// 两种实现共用的配置，对应 v4.2 里的全局变量
+struct Settings {
+    Scene scene;
+    int printPercent = 37;
+    uint32_t progressBarColor = 0xFFFFFF;
+    uint32_t standbyBreathingColor = 0x0080FF;
+    float progressBarBrightnessRatio = 0.8f;
+    float standbyBrightnessRatio = 0.5f;
+    uint8_t globalBrightness = 200;
+    bool overlayMarquee = true;
+};
+
+namespace before {
+
+uint32_t colorScale(uint32_t color, float scale) {
+    scale = constrain(scale, 0.0f, 1.0f);
+    uint8_t r = (uint8_t)(((color >> 16) & 0xFF) * scale);
+    uint8_t g = (uint8_t)(((color >> 8) & 0xFF) * scale);
+    uint8_t b = (uint8_t)((color & 0xFF) * scale);
+    return HostStrip::Color(r, g, b);
+}
+
+uint32_t getRainbowColor(float position) {
+    int hue = (int)(position * 255);
+    int section = hue / 43;
+    int remainder = hue - (section * 43);
+    int intensity = remainder * 6;
+    switch (section) {
+        case 0: return HostStrip::Color(255, intensity, 0);
+        case 1: return HostStrip::Color(255 - intensity, 255, 0);
+        case 2: return HostStrip::Color(0, 255, intensity);
+        case 3: return HostStrip::Color(0, 255 - intensity, 255);
+        case 4: return HostStrip::Color(intensity, 0, 255);
+        default: return HostStrip::Color(255, 0, 255 - intensity);
+    }
+}
+
+void updateLED(HostStrip& strip, const Settings& cfg, unsigned long currentMillis, int& marqueePosition) {
+    const int LED_COUNT = strip.numPixels();
+    strip.clear();
+    float currentBrightnessRatio = 1.0;
+    uint32_t currentBaseColor = 0;
+    strip.setBrightness(constrain(cfg.globalBrightness * currentBrightnessRatio, 0, 255));
+
+    if (cfg.scene == SCENE_PROGRESS_MARQUEE) {
+        currentBrightnessRatio = cfg.progressBarBrightnessRatio;
+        currentBaseColor = cfg.progressBarColor;
+        float pixelsToLight = (float)cfg.printPercent * LED_COUNT / 100.0;
+        int fullPixels = (int)pixelsToLight;
+        float partialPixelBrightness = pixelsToLight - fullPixels;
+
+        fullPixels = constrain(fullPixels, 0, LED_COUNT);
+
+        for (int i = 0; i < fullPixels; i++) {
+            strip.setPixelColor(i, currentBaseColor);
+        }
+
+        if (fullPixels < LED_COUNT && partialPixelBrightness > 0.01) {
+            strip.setPixelColor(fullPixels, colorScale(currentBaseColor, partialPixelBrightness));
+        }
+
+        if (cfg.overlayMarquee) {
+            int currentMarqueePos = marqueePosition;
+            for (int i = 0; i < LED_COUNT; i++) {
+                if (i < fullPixels || (i == fullPixels && partialPixelBrightness > 0.01) || strip.getPixelColor(i) == 0) {
+                    float rainbowPos = ((float)(i - currentMarqueePos + LED_COUNT * 2) / (LED_COUNT * 2.0));
+                    rainbowPos -= (int)rainbowPos;
+                    uint32_t rainbowColor = getRainbowColor(rainbowPos);
+                    uint32_t existingColor = strip.getPixelColor(i);
+
+                    uint8_t r1 = (existingColor >> 16) & 0xFF;
+                    uint8_t g1 = (existingColor >> 8) & 0xFF;
+                    uint8_t b1 = existingColor & 0xFF;
+                    uint8_t r2 = (rainbowColor >> 16) & 0xFF;
+                    uint8_t g2 = (rainbowColor >> 8) & 0xFF;
+                    uint8_t b2 = rainbowColor & 0xFF;
+
+                    float blendFactor = (existingColor == 0) ? 0.3 : 0.5;
+                    strip.setPixelColor(i, HostStrip::Color(
+                        (uint8_t)(r1 * (1.0 - blendFactor) + r2 * blendFactor),
+                        (uint8_t)(g1 * (1.0 - blendFactor) + g2 * blendFactor),
+                        (uint8_t)(b1 * (1.0 - blendFactor) + b2 * blendFactor)
+                    ));
+                }
+            }
+        }
+    } else {
+        currentBrightnessRatio = cfg.standbyBrightnessRatio;
+        if (cfg.scene == SCENE_MARQUEE) {
+            int currentMarqueePos = marqueePosition;
+            for (int i = 0; i < LED_COUNT; i++) {
+                float pos = ((float)(i - currentMarqueePos + LED_COUNT * 2) / (LED_COUNT * 2.0));
+                pos -= (int)pos;
+                strip.setPixelColor(i, getRainbowColor(pos));
+            }
+        } else {
+            currentBaseColor = cfg.standbyBreathingColor;
+            float breath = (sin(currentMillis / 1000.0 * PI) + 1.0) / 2.0;
+            uint32_t breathColor = colorScale(currentBaseColor, breath);
+            for (int i = 0; i < LED_COUNT; i++) {
+                strip.setPixelColor(i, breathColor);
+            }
+        }
+    }
+    (void)currentBrightnessRatio;
+
+    marqueePosition = (marqueePosition - 1) % (LED_COUNT * 2);
+    if (marqueePosition < 0) marqueePosition += LED_COUNT * 2;
+}
+
+}  // namespace before
+
+// 与 v4.2.cpp 的 updateLED() 相同的调用顺序：关掉库内亮度，渲染，统一折算亮度，推进跑马灯。
+// dither 为 false 时传空指针，只比较 Q8 定点化本身，不含时间抖动的开销
+void renderQ8(HostStrip& strip, const Settings& cfg, unsigned long currentMillis, int& marqueePosition,
+              TemporalDither* edgeDither, TemporalDither* breathDither) {
+    strip.clear();
+    strip.setBrightness(255);
+    const uint8_t brightness = cfg.globalBrightness;
+    ScaledRange scaled = { 0, 0 };
+    if (cfg.scene == SCENE_PROGRESS_MARQUEE) {
+        renderProgress(strip, (uint32_t)cfg.printPercent << 8, cfg.progressBarColor, cfg.overlayMarquee,
+                       marqueePosition, brightness, edgeDither, scaled);
+    } else if (cfg.scene == SCENE_MARQUEE) {
+        renderMarquee(strip, marqueePosition);
+    } else {
+        renderBreathing(strip, cfg.standbyBreathingColor, wave8(currentMillis, 2000), brightness, breathDither, scaled);
+    }
+    applyBrightness(strip, brightness, scaled);
+    marqueePosition = advanceMarquee(marqueePosition, strip.numPixels() * 2);
+}
+
+static volatile uint32_t sink;   // 防止编译器把渲染结果整体优化掉
+
+template <typename Render>
+static double nsPerFrame(uint16_t length, unsigned long frames, Render render) {
+    HostStrip strip(length);
+    int marqueePosition = 0;
+    uint32_t sum = 0;
+    auto started = std::chrono::steady_clock::now();
+    for (unsigned long f = 0; f < frames; f++) {
+        render(strip, f * 33, marqueePosition);
+        sum += strip.getPixelColor(f % length);   // 每帧只取一颗，开销与灯珠数无关
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count();
+    sink = sum;
+    return ns / frames;
+}
+
+int main(int argc, char** argv) {
+    unsigned long frames = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000;
+    if (frames == 0) frames = 1;
+    static const struct { Scene scene; const char* name; } SCENES[] = {
+        { SCENE_PROGRESS_MARQUEE, "progress+marquee" },
+        { SCENE_BREATHING, "breathing" },
+        { SCENE_MARQUEE, "marquee" },
+    };
+    static const uint16_t LENGTHS[] = { 60, 300, 1024 };
+    printf("%-17s %6s %14s %14s %14s %8s\n", "scene", "leds", "float ns/frame", "q8 ns/frame", "q8+dither", "speedup");
+    for (const auto& s : SCENES) {
+        Settings cfg;
+        cfg.scene = s.scene;
+        for (uint16_t length : LENGTHS) {
+            double floatNs = nsPerFrame(length, frames, [&](HostStrip& strip, unsigned long ms, int& pos) {
+                before::updateLED(strip, cfg, ms, pos);
+            });
+            double q8Ns = nsPerFrame(length, frames, [&](HostStrip& strip, unsigned long ms, int& pos) {
+                renderQ8(strip, cfg, ms, pos, nullptr, nullptr);
+            });
+            TemporalDither edge = {}, breath = {};
+            double ditherNs = nsPerFrame(length, frames, [&](HostStrip& strip, unsigned long ms, int& pos) {
+                renderQ8(strip, cfg, ms, pos, &edge, &breath);
+            });
+            // 加速比按不含抖动的 Q8 计算
+            printf("%-17s %6u %14.0f %14.0f %14.0f %7.2fx\n", s.name, (unsigned)length, floatNs, q8Ns, ditherNs,
+                   floatNs / q8Ns);
+        }
+    }
+    return 0;
+}
@@ -11,10 +11,16 @@
 #include <Ticker.h>
 #include <pgmspace.h>
 
-// LED 灯带配置
-#define LED_PIN D4
-#define LED_COUNT 20
-Adafruit_NeoPixel strip(LED_COUNT, LED_PIN, NEO_GRB + NEO_KHZ800);
+// LED 灯带配置：长度、引脚和颜色顺序在启动时从配置读取，这里只是默认值
+#define DEFAULT_LED_PIN D4
+#define DEFAULT_LED_COUNT 20
+#define MAX_LED_COUNT 1024
+Adafruit_NeoPixel strip(DEFAULT_LED_COUNT, DEFAULT_LED_PIN, NEO_GRB + NEO_KHZ800);
+
+// 支持的灯珠颜色顺序，名称与类型一一对应
+const char* const COLOR_ORDER_NAMES[] = { "GRB", "RGB", "BRG", "RBG", "GBR", "BGR" };
+const neoPixelType COLOR_ORDER_TYPES[] = { NEO_GRB, NEO_RGB, NEO_BRG, NEO_RBG, NEO_GBR, NEO_BGR };
+const uint8_t COLOR_ORDER_COUNT = 6;
 
 // MQTT 服务器配置（存储在 PROGMEM）
 const char MQTT_SERVER[] PROGMEM = "cn.mqtt.bambulab.com";
@@ -39,6 +45,9 @@ uint32_t standbyBreathingColor = strip.Color(0, 0, 255); // 蓝色
 float progressBarBrightnessRatio = 1.0;
 float standbyBrightnessRatio = 1.0;
 unsigned long customPushallInterval = 30; // 自定义 pushall 间隔（秒）
+uint16_t ledCount = DEFAULT_LED_COUNT;    // 灯带参数修改后重启生效
+uint8_t ledPin = DEFAULT_LED_PIN;
+char ledColorOrder[4] = "GRB";
 
 // MQTT 主题（存储在 PROGMEM）
 const char MQTT_TOPIC_SUB[] PROGMEM = "device/{DEVICE_ID}/report";
@@ -60,6 +69,13 @@ const long mqttResponseTimeout = 60000; // 60秒 MQTT 响应超时
 const long webResponseTimeout = 20000; // 20秒 Web 响应超时
 bool isWebServing = false;
 bool pendingPushall = false;
+// 页面内嵌了当前配置，每次重新生成都换一个 ETag；带上启动随机数，重启后不会误命中旧缓存
+char indexEtag[20] = "";
+// 报告序号跟踪：只在序号断档、重连或长时间无报告时请求全量包
+uint32_t lastSequenceId = 0;
+bool sequenceSynced = false;
+uint32_t pushallSequenceId = 0;
+const unsigned long PUSHALL_MIN_INTERVAL = 5000; // 两次全量包请求的最小间隔（毫秒）
 bool printerOffline = false;
 bool pauseLedUpdate = false;
 bool pauseMqttUpdate = false; // 新增：暂停 MQTT 处理
@@ -68,6 +84,7 @@ bool pauseMqttUpdate = false; // 新增：暂停 MQTT 处理
 unsigned long lastLedUpdate = 0;
 const long ledUpdateInterval = 33;
 int marqueePosition = 0;
+uint16_t pixelScale = 256;        // 当前帧写像素时的亮度系数（Q8，256 为原色）
 bool apClientConnected = false;
 
 // LED 测试状态机
@@ -116,11 +133,124 @@ const long watchdogTimeout = 30000;
 unsigned long lastLedProcessTime = 0;
 unsigned long lastModeJudgmentTime = 0;
 
-// MQTT 缓冲区文件
+// MQTT 缓冲区文件（仅在内存环形缓冲区溢出时使用）
 const char* MQTT_RX_BUFFER = "/mqtt_rx_buffer.json";
 const char* MQTT_TX_BUFFER = "/mqtt_tx_buffer.json";
 const size_t MQTT_BUFFER_BLOCK_SIZE = 512; // 每次读写 512 字节
 
+// MQTT 内存环形缓冲区（单生产者/单消费者，无锁）
+// 生产者只推进 head，消费者只推进 tail；记录格式为 4 字节长度前缀 + 数据
+const size_t MQTT_RX_RING_SIZE = 2048; // 必须为 2 的幂
+const size_t MQTT_TX_RING_SIZE = 512;  // 必须为 2 的幂
+struct MqttRing {
+  uint8_t* data;
+  uint32_t mask;
+  volatile uint32_t head;
+  volatile uint32_t tail;
+  bool spilled; // 已有记录溢出到文件，后续记录也写入文件以保持顺序
+};
+uint8_t mqttRxRingData[MQTT_RX_RING_SIZE];
+uint8_t mqttTxRingData[MQTT_TX_RING_SIZE];
+MqttRing mqttRxRing = { mqttRxRingData, MQTT_RX_RING_SIZE - 1, 0, 0, false };
+MqttRing mqttTxRing = { mqttTxRingData, MQTT_TX_RING_SIZE - 1, 0, 0, false };
+
+// --- 增量 JSON 报告解析 ---
+// PubSubClient 把 PUBLISH 负载逐字节写入 reportTokenizer，边收边提取关心的字段：
+// 报告再大也只占用固定内存，回调触发时再压缩成一条小记录写入接收缓冲
+class ReportTokenizer : public Stream {
+public:
+  enum : uint8_t { F_GCODE_STATE = 1, F_MC_PERCENT = 2, F_REMAINING_TIME = 4, F_LAYER_NUM = 8, F_SEQUENCE_ID = 16 };
+
+  char gcodeState[16];
+  int32_t mcPercent;
+  int32_t remainingTime;
+  int32_t layerNum;
+  uint32_t sequenceId;
+  uint8_t fields;
+
+  ReportTokenizer() { reset(); }
+  void reset();
+  size_t toRecord(char* out, size_t size) const;
+  bool complete() const { return closed; }   // 已收到完整的顶层对象
+
+  size_t write(uint8_t c) override;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+
+private:
+  void appendValue(char c);
+  void endValue();
+  uint8_t fieldForKey() const;
+
+  uint8_t depth;
+  uint32_t arrayBits;   // 第 n 层容器是否为数组
+  bool inString;
+  bool escaped;
+  bool readingKey;
+  bool expectKey;
+  bool inPrint;
+  bool closed;
+  uint8_t target;       // 当前值要写入的字段位，0 表示跳过
+  char key[20];
+  uint8_t keyLen;
+  char value[24];
+  uint8_t valueLen;
+};
+ReportTokenizer reportTokenizer;
+
+// --- 编译期生成的查找表（存放在 flash 中） ---
+// 单文件固件无法引用 v5 的 lut.h，以下是 Esp32c3/v5.0/c3-main/src/lut.cpp 中生成器的同步副本：
+// 修改时先改 lut.cpp 再同步过来，native 测试 lut_sync 会检查两者一致
+constexpr double LUT_HALF_PI = 1.5707963267948966;
+
+// sin 的泰勒展开，在 0 到 π/2 内误差小于 1e-5
+constexpr double lutSin(double x) {
+  return x - x * x * x / 6 + x * x * x * x * x / 120 - x * x * x * x * x * x * x / 5040 +
+         x * x * x * x * x * x * x * x * x / 362880;
+}
+
+// 牛顿迭代求五次方根，用于 x^2.2 = x^2 * x^0.2
+constexpr double lutRoot5(double x, double g, int n) {
+  return n == 0 ? g : lutRoot5(x, (4 * g + x / (g * g * g * g)) / 5, n - 1);
+}
+
+constexpr uint8_t lutGamma(int i) {
+  return i == 0 ? 0 : (uint8_t)(255.0 * (i / 255.0) * (i / 255.0) * lutRoot5(i / 255.0, 1.0, 24) + 0.5);
+}
+
+// 四分之一周期正弦，幅度 0-127
+constexpr uint8_t lutQuarterSine(int i) {
+  return (uint8_t)(127.0 * lutSin(i * LUT_HALF_PI / 64) + 0.5);
+}
+
+// HSV 色环：每 43 个 hue 一段，段内线性过渡，存表前做 gamma 校正
+constexpr uint32_t lutPack(int r, int g, int b) {
+  return ((uint32_t)lutGamma(r) << 16) | ((uint32_t)lutGamma(g) << 8) | lutGamma(b);
+}
+
+constexpr uint32_t lutRainbowSection(int section, int intensity) {
+  return section == 0 ? lutPack(255, intensity, 0)
+       : section == 1 ? lutPack(255 - intensity, 255, 0)
+       : section == 2 ? lutPack(0, 255, intensity)
+       : section == 3 ? lutPack(0, 255 - intensity, 255)
+       : section == 4 ? lutPack(intensity, 0, 255)
+       : lutPack(255, 0, 255 - intensity);
+}
+
+constexpr uint32_t lutRainbow(int hue) {
+  return lutRainbowSection(hue / 43, (hue % 43) * 6);
+}
+
+#define LUT_R4(f, i) f(i), f(i + 1), f(i + 2), f(i + 3)
+#define LUT_R16(f, i) LUT_R4(f, i), LUT_R4(f, i + 4), LUT_R4(f, i + 8), LUT_R4(f, i + 12)
+#define LUT_R64(f, i) LUT_R16(f, i), LUT_R16(f, i + 16), LUT_R16(f, i + 32), LUT_R16(f, i + 48)
+#define LUT_R256(f) LUT_R64(f, 0), LUT_R64(f, 64), LUT_R64(f, 128), LUT_R64(f, 192)
+
+const uint32_t RAINBOW_LUT[256] PROGMEM = { LUT_R256(lutRainbow) };
+const uint8_t GAMMA_LUT[256] PROGMEM = { LUT_R256(lutGamma) };
+const uint8_t QUARTER_SINE_LUT[65] PROGMEM = { LUT_R64(lutQuarterSine, 0), lutQuarterSine(64) };
+
 // HTML 静态内容（存储在 PROGMEM）
 const char HTML_HEAD[] PROGMEM = R"(
 <!DOCTYPE html>
@@ -177,7 +307,7 @@ const char HTML_FORM[] PROGMEM = R"(
 <input type='number' id='progressBarBrightnessRatio' name='progressBarBrightnessRatio' min='0' max='1' step='0.1' value='%f' required>
 <label for='standbyBrightnessRatio'>待机亮度比例（0.0-1.0）</label>
 <input type='number' id='standbyBrightnessRatio' name='standbyBrightnessRatio' min='0' max='1' step='0.1' value='%f' required>
-<label for='customPushallInterval'>全量包请求间隔（10-600秒）</label>
+<label for='customPushallInterval'>无报告时请求全量包（10-600秒）</label>
 <input type='number' id='customPushallInterval' name='customPushallInterval' min='10' max='600' value='%lu' required>
 <label><input type='checkbox' id='overlayMarquee' name='overlayMarquee'%s> 在进度条上叠加跑马灯</label>
 <button type='submit'>保存配置</button>
@@ -302,12 +432,18 @@ window.onload = function() {
 void configModeCallback(WiFiManager *myWiFiManager);
 void saveConfigCallback();
 void loadConfig();
+void applyStripConfig();
+int findColorOrder(const char* name);
 void saveConfig();
 void reconnectMQTT();
 void mqttCallback(char* topic, byte* payload, unsigned int length);
+void trackReportSequence(uint32_t seq);
 void sendPushall();
 void processMqttRxBuffer();
-uint32_t getRainbowColor(float position);
+uint32_t getRainbowColor(uint8_t hue);
+void setPixelScale(int brightness);
+void setScaledPixel(uint16_t index, uint32_t color);
+uint8_t lutSine8(uint8_t phase);
 void updateLED();
 void updateTestLed();
 bool checkClientAccess();
@@ -323,42 +459,29 @@ bool isConfigValid();
 bool isPrinting();
 void watchdogCallback();
 void sendFileInChunks(const char* filepath);
+void ringReset(MqttRing &ring);
+bool ringPush(MqttRing &ring, const uint8_t* data, uint32_t length);
+bool ringPeek(const MqttRing &ring, char* out, size_t outSize, size_t &length);
+void ringDrop(MqttRing &ring);
+void spillMqttRecord(const char* path, const uint8_t* data, uint32_t length);
 void writeMqttRxBuffer(const byte* data, unsigned int length);
 void writeMqttTxBuffer(const char* data, size_t length);
 bool readMqttBufferBlock(const char* filepath, char* buffer, size_t bufferSize, size_t& offset, size_t& bytesRead);
+void applyMqttReport(const char* payload, size_t length);
+void flushMqttTxBuffer();
 void initStaticHtml();
+void writeProgmemToFile(File &file, const char* progmem_ptr);
 
-// 初始化静态 HTML 文件
-void initStaticHtml() {
-  if (!LittleFS.exists("/")) {
-    if (!LittleFS.mkdir("/")) {
-      Serial.println(F("无法创建根目录"));
-      return;
-    }
-    Serial.println(F("根目录已创建"));
-  }
-
-  File file = LittleFS.open("/index.html", "w");
-  if (!file) {
-    Serial.println(F("无法创建 /index.html"));
-    return;
-  }
-
-  char progressBarColorHex[8];
-  char standbyBreathingColorHex[8];
-  snprintf(progressBarColorHex, sizeof(progressBarColorHex), "#%06X", progressBarColor);
-  snprintf(standbyBreathingColorHex, sizeof(standbyBreathingColorHex), "#%06X", standbyBreathingColor);
+// 配置表单分两段格式化，每段都能放进 2KB 的栈缓冲区
+const uint8_t CONFIG_FORM_PARTS = 2;
 
-  // 写入 HTML_HEAD
-  size_t bytesWritten = 0;
-  for (size_t i = 0; i < strlen_P(HTML_HEAD); i++) {
-    bytesWritten += file.write(pgm_read_byte(HTML_HEAD + i));
-  }
-
-  // 写入 HTML_FORM（动态填充）
-  char formBuffer[2048];
-  snprintf(formBuffer, sizeof(formBuffer),
-           PSTR(R"(
+size_t formatConfigForm(char* out, size_t size, uint8_t part) {
+  if (part == 0) {
+    char progressBarColorHex[8];
+    char standbyBreathingColorHex[8];
+    snprintf(progressBarColorHex, sizeof(progressBarColorHex), "#%06X", progressBarColor);
+    snprintf(standbyBreathingColorHex, sizeof(standbyBreathingColorHex), "#%06X", standbyBreathingColor);
+    snprintf_P(out, size, PSTR(R"(
 <label for='uid'>用户ID</label>
 <input type='text' id='uid' name='uid' value='%s' required>
 <label for='accessToken'>访问令牌</label>
@@ -378,13 +501,26 @@ void initStaticHtml() {
 <label for='standbyBreathingColor'>待机呼吸灯颜色</label>
 <input type='color' id='standbyBreathingColorPicker' name='standbyBreathingColorPicker' value='%s'>
 <input type='text' id='standbyBreathingColor' name='standbyBreathingColor' value='%s' pattern='#[0-9A-Fa-f]{6}' required>
-<label for='progressBarBrightnessRatio'>进度条亮度比例（0.0-1.0）</label>
+)"),
+               uid, accessToken, deviceID, globalBrightness,
+               strcmp(standbyMode, "marquee") == 0 ? " selected" : "",
+               strcmp(standbyMode, "breathing") == 0 ? " selected" : "",
+               progressBarColorHex, progressBarColorHex,
+               standbyBreathingColorHex, standbyBreathingColorHex);
+  } else {
+    snprintf_P(out, size, PSTR(R"(<label for='progressBarBrightnessRatio'>进度条亮度比例（0.0-1.0）</label>
 <input type='number' id='progressBarBrightnessRatio' name='progressBarBrightnessRatio' min='0' max='1' step='0.1' value='%f' required>
 <label for='standbyBrightnessRatio'>待机亮度比例（0.0-1.0）</label>
 <input type='number' id='standbyBrightnessRatio' name='standbyBrightnessRatio' min='0' max='1' step='0.1' value='%f' required>
-<label for='customPushallInterval'>全量包请求间隔（10-600秒）</label>
+<label for='customPushallInterval'>无报告时请求全量包（10-600秒）</label>
 <input type='number' id='customPushallInterval' name='customPushallInterval' min='10' max='600' value='%lu' required>
 <label><input type='checkbox' id='overlayMarquee' name='overlayMarquee'%s> 在进度条上叠加跑马灯</label>
+<label for='ledCount'>灯珠数量（重启后生效）</label>
+<input type='number' id='ledCount' name='ledCount' min='1' max='%d' value='%u' required>
+<label for='ledPin'>数据引脚 GPIO（重启后生效）</label>
+<input type='number' id='ledPin' name='ledPin' min='0' max='16' value='%u' required>
+<label for='ledColorOrder'>颜色顺序，如 GRB、RGB（重启后生效）</label>
+<input type='text' id='ledColorOrder' name='ledColorOrder' maxlength='3' pattern='[RGB]{3}' value='%s' required>
 <button type='submit'>保存配置</button>
 </form>
 </div>
@@ -409,25 +545,67 @@ void initStaticHtml() {
 </div>
 </div>
 )"),
-           uid, accessToken, deviceID, globalBrightness,
-           strcmp(standbyMode, "marquee") == 0 ? " selected" : "",
-           strcmp(standbyMode, "breathing") == 0 ? " selected" : "",
-           progressBarColorHex, progressBarColorHex,
-           standbyBreathingColorHex, standbyBreathingColorHex,
-           progressBarBrightnessRatio, standbyBrightnessRatio,
-           customPushallInterval, overlayMarquee ? " checked" : "");
-  bytesWritten += file.print(formBuffer);
+               progressBarBrightnessRatio, standbyBrightnessRatio,
+               customPushallInterval, overlayMarquee ? " checked" : "",
+               MAX_LED_COUNT, ledCount, ledPin, ledColorOrder);
+  }
+  return strlen(out);
+}
 
-  // 写入 HTML_SCRIPT
-  for (size_t i = 0; i < strlen_P(HTML_SCRIPT); i++) {
-    bytesWritten += file.write(pgm_read_byte(HTML_SCRIPT + i));
+// 初始化静态 HTML 文件
+void initStaticHtml() {
+  if (!LittleFS.exists("/")) {
+    if (!LittleFS.mkdir("/")) {
+      Serial.println(F("无法创建根目录"));
+      return;
+    }
+    Serial.println(F("根目录已创建"));
+  }
+
+  indexEtag[0] = '\0';
+  File file = LittleFS.open("/index.html", "w");
+  if (!file) {
+    Serial.println(F("无法创建 /index.html"));
+    return;
+  }
+
+  // 写入 HTML_HEAD
+  writeProgmemToFile(file, HTML_HEAD);
+
+  // 写入 HTML_FORM（动态填充）
+  char formBuffer[2048];
+  for (uint8_t part = 0; part < CONFIG_FORM_PARTS; part++) {
+    formatConfigForm(formBuffer, sizeof(formBuffer), part);
+    file.print(formBuffer);
   }
 
+  // 写入 HTML_SCRIPT
+  writeProgmemToFile(file, HTML_SCRIPT);
+
+  size_t bytesWritten = file.size();
   file.close();
+  static uint32_t bootNonce = ESP.random();
+  static uint16_t generation = 0;
+  snprintf(indexEtag, sizeof(indexEtag), "\"%08lx-%u\"", (unsigned long)bootNonce, ++generation);
   Serial.println(F("index.html 已写入，长度："));
   Serial.println(bytesWritten);
 }
 
+// 按块从 PROGMEM 拷贝再写入，避免逐字节调用 file.write
+void writeProgmemToFile(File &file, const char* progmem_ptr) {
+  char buffer[256];
+  size_t totalLen = strlen_P(progmem_ptr);
+  for (size_t i = 0; i < totalLen; i += sizeof(buffer)) {
+    size_t len = min(sizeof(buffer), totalLen - i);
+    memcpy_P(buffer, progmem_ptr + i, len);
+    if (file.write(reinterpret_cast<const uint8_t*>(buffer), len) != len) {
+      Serial.println(F("写入 PROGMEM 块失败"));
+      break;
+    }
+    yield();
+  }
+}
+
 // 分块发送文件
 void sendFileInChunks(const char* filepath) {
   isWebServing = true;
@@ -450,10 +628,6 @@ void sendFileInChunks(const char* filepath) {
     Serial.println(F("堆内存低（"));
     Serial.print(ESP.getFreeHeap());
     Serial.println(F("字节），使用 PROGMEM 缓冲区"));
-    char progressBarColorHex[8];
-    char standbyBreathingColorHex[8];
-    snprintf(progressBarColorHex, sizeof(progressBarColorHex), "#%06X", progressBarColor);
-    snprintf(standbyBreathingColorHex, sizeof(standbyBreathingColorHex), "#%06X", standbyBreathingColor);
 
     // 直接从 PROGMEM 发送 HTML
     server.setContentLength(CONTENT_LENGTH_UNKNOWN);
@@ -465,9 +639,7 @@ void sendFileInChunks(const char* filepath) {
     size_t headLen = strlen_P(HTML_HEAD);
     for (size_t i = 0; i < headLen; i += chunkSize) {
       size_t len = min(chunkSize, headLen - i);
-      for (size_t j = 0; j < len; j++) {
-        buffer[j] = pgm_read_byte(HTML_HEAD + i + j);
-      }
+      memcpy_P(buffer, HTML_HEAD + i, len);
       server.client().write(buffer, len);
       yield();
       if (millis() - startTime > 2000) {
@@ -482,77 +654,20 @@ void sendFileInChunks(const char* filepath) {
 
     // 发送 HTML_FORM
     char formBuffer[2048];
-    snprintf(formBuffer, sizeof(formBuffer),
-             PSTR(R"(
-<label for='uid'>用户ID</label>
-<input type='text' id='uid' name='uid' value='%s' required>
-<label for='accessToken'>访问令牌</label>
-<input type='text' id='accessToken' name='accessToken' maxlength='256' value='%s' required>
-<label for='deviceID'>设备序列号</label>
-<input type='text' id='deviceID' name='deviceID' value='%s' required>
-<label for='brightness'>全局亮度（0-255）</label>
-<input type='number' id='brightness' name='brightness' min='0' max='255' value='%d' required>
-<label for='standbyMode'>待机模式</label>
-<select id='standbyMode' name='standbyMode'>
-<option value='marquee'%s>彩虹跑马灯</option>
-<option value='breathing'%s>呼吸灯</option>
-</select>
-<label for='progressBarColor'>进度条颜色</label>
-<input type='color' id='progressBarColorPicker' name='progressBarColorPicker' value='%s'>
-<input type='text' id='progressBarColor' name='progressBarColor' value='%s' pattern='#[0-9A-Fa-f]{6}' required>
-<label for='standbyBreathingColor'>待机呼吸灯颜色</label>
-<input type='color' id='standbyBreathingColorPicker' name='standbyBreathingColorPicker' value='%s'>
-<input type='text' id='standbyBreathingColor' name='standbyBreathingColor' value='%s' pattern='#[0-9A-Fa-f]{6}' required>
-<label for='progressBarBrightnessRatio'>进度条亮度比例（0.0-1.0）</label>
-<input type='number' id='progressBarBrightnessRatio' name='progressBarBrightnessRatio' min='0' max='1' step='0.1' value='%f' required>
-<label for='standbyBrightnessRatio'>待机亮度比例（0.0-1.0）</label>
-<input type='number' id='standbyBrightnessRatio' name='standbyBrightnessRatio' min='0' max='1' step='0.1' value='%f' required>
-<label for='customPushallInterval'>全量包请求间隔（10-600秒）</label>
-<input type='number' id='customPushallInterval' name='customPushallInterval' min='10' max='600' value='%lu' required>
-<label><input type='checkbox' id='overlayMarquee' name='overlayMarquee'%s> 在进度条上叠加跑马灯</label>
-<button type='submit'>保存配置</button>
-</form>
-</div>
-<div class='card'>
-<div class='button-group'>
-<button onclick='testLed()'>测试 LED 灯带</button>
-<button onclick='clearCache()'>清除缓存</button>
-<button onclick='resetConfig()'>重置配置</button>
-<button onclick='restart()'>一键重启</button>
-</div>
-<div style='margin-top: 16px; display: flex; gap: 8px;'>
-<select id='switchMode' name='mode'>
-<option value='progress'>进度条</option>
-<option value='standby'>待机</option>
-</select>
-<button onclick='switchMode()'>切换模式</button>
-</div>
-</div>
-<div class='card'>
-<h2>日志</h2>
-<div class='log-container' id='log'>正在加载日志...</div>
-</div>
-</div>
-)"),
-             uid, accessToken, deviceID, globalBrightness,
-             strcmp(standbyMode, "marquee") == 0 ? " selected" : "",
-             strcmp(standbyMode, "breathing") == 0 ? " selected" : "",
-             progressBarColorHex, progressBarColorHex,
-             standbyBreathingColorHex, standbyBreathingColorHex,
-             progressBarBrightnessRatio, standbyBrightnessRatio,
-             customPushallInterval, overlayMarquee ? " checked" : "");
-    size_t formLen = strlen(formBuffer);
-    for (size_t i = 0; i < formLen; i += chunkSize) {
-      size_t len = min(chunkSize, formLen - i);
-      server.client().write(formBuffer + i, len);
-      yield();
-      if (millis() - startTime > 2000) {
-        Serial.println(F("Web 响应超时（低内存模式）"));
-        server.client().stop();
-        isWebServing = false;
-        pauseLedUpdate = false;
-        pauseMqttUpdate = false;
-        return;
+    for (uint8_t part = 0; part < CONFIG_FORM_PARTS; part++) {
+      size_t formLen = formatConfigForm(formBuffer, sizeof(formBuffer), part);
+      for (size_t i = 0; i < formLen; i += chunkSize) {
+        size_t len = min(chunkSize, formLen - i);
+        server.client().write(formBuffer + i, len);
+        yield();
+        if (millis() - startTime > 2000) {
+          Serial.println(F("Web 响应超时（低内存模式）"));
+          server.client().stop();
+          isWebServing = false;
+          pauseLedUpdate = false;
+          pauseMqttUpdate = false;
+          return;
+        }
       }
     }
 
@@ -560,9 +675,7 @@ void sendFileInChunks(const char* filepath) {
     size_t scriptLen = strlen_P(HTML_SCRIPT);
     for (size_t i = 0; i < scriptLen; i += chunkSize) {
       size_t len = min(chunkSize, scriptLen - i);
-      for (size_t j = 0; j < len; j++) {
-        buffer[j] = pgm_read_byte(HTML_SCRIPT + i + j);
-      }
+      memcpy_P(buffer, HTML_SCRIPT + i, len);
       server.client().write(buffer, len);
       yield();
       if (millis() - startTime > 2000) {
@@ -654,46 +767,108 @@ void watchdogCallback() {
   }
 }
 
-// 写入 MQTT 接收缓冲区
-void writeMqttRxBuffer(const byte* data, unsigned int length) {
-  File file = LittleFS.open(MQTT_RX_BUFFER, "a");
+// 重置环形缓冲区
+void ringReset(MqttRing &ring) {
+  ring.head = 0;
+  ring.tail = 0;
+  ring.spilled = false;
+}
+
+static void ringCopyIn(MqttRing &ring, uint32_t pos, const uint8_t* src, size_t len) {
+  size_t offset = pos & ring.mask;
+  size_t first = min(len, (size_t)ring.mask + 1 - offset);
+  memcpy(ring.data + offset, src, first);
+  memcpy(ring.data, src + first, len - first);
+}
+
+static void ringCopyOut(const MqttRing &ring, uint32_t pos, uint8_t* dst, size_t len) {
+  size_t offset = pos & ring.mask;
+  size_t first = min(len, (size_t)ring.mask + 1 - offset);
+  memcpy(dst, ring.data + offset, first);
+  memcpy(dst + first, ring.data, len - first);
+}
+
+// 写入一条记录，空间不足时返回 false
+bool ringPush(MqttRing &ring, const uint8_t* data, uint32_t length) {
+  uint32_t head = ring.head;
+  uint32_t used = head - ring.tail;
+  if (sizeof(length) + length > ring.mask + 1 - used) {
+    return false;
+  }
+  ringCopyIn(ring, head, reinterpret_cast<const uint8_t*>(&length), sizeof(length));
+  ringCopyIn(ring, head + sizeof(length), data, length);
+  ring.head = head + sizeof(length) + length; // 数据写完后再发布 head
+  return true;
+}
+
+// 读取队首记录但不出队；记录超过 outSize 时只返回长度，不复制数据
+bool ringPeek(const MqttRing &ring, char* out, size_t outSize, size_t &length) {
+  uint32_t tail = ring.tail;
+  if (ring.head == tail) {
+    return false;
+  }
+  uint32_t recordLength;
+  ringCopyOut(ring, tail, reinterpret_cast<uint8_t*>(&recordLength), sizeof(recordLength));
+  length = recordLength;
+  if (recordLength <= outSize) {
+    ringCopyOut(ring, tail + sizeof(recordLength), reinterpret_cast<uint8_t*>(out), recordLength);
+  }
+  return true;
+}
+
+// 丢弃队首记录
+void ringDrop(MqttRing &ring) {
+  uint32_t tail = ring.tail;
+  if (ring.head == tail) {
+    return;
+  }
+  uint32_t recordLength;
+  ringCopyOut(ring, tail, reinterpret_cast<uint8_t*>(&recordLength), sizeof(recordLength));
+  ring.tail = tail + sizeof(recordLength) + recordLength;
+}
+
+// 环形缓冲区溢出时追加到闪存文件
+void spillMqttRecord(const char* path, const uint8_t* data, uint32_t length) {
+  File file = LittleFS.open(path, "a");
   if (!file) {
-    Serial.println(F("无法打开 MQTT 接收缓冲区文件"));
+    Serial.println(F("无法打开 MQTT 溢出缓冲区文件："));
+    Serial.println(path);
     return;
   }
   // 写入长度前缀（4 字节）
-  file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+  file.write(reinterpret_cast<const uint8_t*>(&length), sizeof(length));
   // 写入数据
-  size_t bytesWritten = file.write(reinterpret_cast<const char*>(data), length);
+  size_t bytesWritten = file.write(data, length);
   file.close();
   if (bytesWritten != length) {
-    Serial.println(F("写入 MQTT 接收缓冲区失败，写入字节："));
+    Serial.println(F("写入 MQTT 溢出缓冲区失败，写入字节："));
     Serial.println(bytesWritten);
-  } else {
-    Serial.println(F("写入 MQTT 接收缓冲区，长度："));
-    Serial.println(length);
   }
 }
 
+// 写入 MQTT 接收缓冲区
+void writeMqttRxBuffer(const byte* data, unsigned int length) {
+  if (!mqttRxRing.spilled && ringPush(mqttRxRing, data, length)) {
+    return;
+  }
+  if (!mqttRxRing.spilled) {
+    Serial.println(F("MQTT 接收环形缓冲区已满，溢出到闪存"));
+    mqttRxRing.spilled = true;
+  }
+  spillMqttRecord(MQTT_RX_BUFFER, data, length);
+}
+
 // 写入 MQTT 发送缓冲区
 void writeMqttTxBuffer(const char* data, size_t length) {
-  File file = LittleFS.open(MQTT_TX_BUFFER, "a");
-  if (!file) {
-    Serial.println(F("无法打开 MQTT 发送缓冲区文件"));
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+  if (!mqttTxRing.spilled && ringPush(mqttTxRing, bytes, length)) {
     return;
   }
-  // 写入长度前缀（4 字节）
-  file.write(reinterpret_cast<const char*>(&length), sizeof(length));
-  // 写入数据
-  size_t bytesWritten = file.write(data, length);
-  file.close();
-  if (bytesWritten != length) {
-    Serial.println(F("写入 MQTT 发送缓冲区失败，写入字节："));
-    Serial.println(bytesWritten);
-  } else {
-    Serial.println(F("写入 MQTT 发送缓冲区，长度："));
-    Serial.println(length);
+  if (!mqttTxRing.spilled) {
+    Serial.println(F("MQTT 发送环形缓冲区已满，溢出到闪存"));
+    mqttTxRing.spilled = true;
   }
+  spillMqttRecord(MQTT_TX_BUFFER, bytes, length);
 }
 
 // 分块读取缓冲区
@@ -736,73 +911,97 @@ bool readMqttBufferBlock(const char* filepath, char* buffer, size_t bufferSize,
   return true;
 }
 
-// 处理 MQTT 接收缓冲区
-void processMqttRxBuffer() {
-  if (pauseMqttUpdate || !LittleFS.exists(MQTT_RX_BUFFER)) {
+// 解析一条打印机报告并更新状态
+void applyMqttReport(const char* payload, size_t length) {
+  JsonDocument doc;
+  DeserializationError error = deserializeJson(doc, payload, length);
+  if (error) {
+    Serial.println(F("JSON 解析失败："));
+    Serial.println(error.c_str());
     return;
   }
 
-  size_t offset = 0;
-  char buffer[MQTT_BUFFER_BLOCK_SIZE];
-  size_t bytesRead;
+  if (doc["print"].isNull()) {
+    Serial.print(F("收到非 print 消息：command="));
+    Serial.println(doc["command"] | "unknown");
+    return;
+  }
 
-  while (readMqttBufferBlock(MQTT_RX_BUFFER, buffer, MQTT_BUFFER_BLOCK_SIZE, offset, bytesRead)) {
-    JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, buffer, bytesRead);
-    if (error) {
-      Serial.println(F("JSON 解析失败："));
-      Serial.println(error.c_str());
-      continue;
+  lastMqttResponseTime = millis();
+  JsonObject printData = doc["print"];
+  if (doc["command"] && doc["command"] == "pushall") {
+    printerState.clear();
+    for (JsonPair kv : printData) {
+      printerState[kv.key()] = kv.value();
     }
-
-    if (doc["print"].isNull()) {
-      Serial.print(F("收到非 print 消息：command="));
-      Serial.println(doc["command"] | "unknown");
-      continue;
+    Serial.println(F("全量更新完成"));
+  } else {
+    for (JsonPair kv : printData) {
+      printerState[kv.key()] = kv.value();
     }
+    Serial.println(F("增量更新完成"));
+  }
 
-    lastMqttResponseTime = millis();
-    JsonObject printData = doc["print"];
-    if (doc["command"] && doc["command"] == "pushall") {
-      printerState.clear();
-      for (JsonPair kv : printData) {
-        printerState[kv.key()] = kv.value();
-      }
-      Serial.println(F("全量更新完成"));
+  gcodeState = printerState["gcode_state"] | "UNKNOWN";
+  printPercent = printerState["mc_percent"] | 0;
+  remainingTime = printerState["mc_remaining_time"] | 0;
+  layerNum = printerState["layer_num"] | 0;
+
+  if (forcedMode == NONE) {
+    if (isPrinting()) {
+      currentState = PRINTING;
+    } else if (gcodeState == "FAILED") {
+      currentState = ERROR;
     } else {
-      for (JsonPair kv : printData) {
-        printerState[kv.key()] = kv.value();
-      }
-      Serial.println(F("增量更新完成"));
+      currentState = CONNECTED_PRINTER;
     }
+  } else if (forcedMode == PROGRESS) {
+    currentState = PRINTING;
+  } else if (forcedMode == STANDBY) {
+    currentState = CONNECTED_PRINTER;
+  }
 
-    gcodeState = printerState["gcode_state"] | "UNKNOWN";
-    printPercent = printerState["mc_percent"] | 0;
-    remainingTime = printerState["mc_remaining_time"] | 0;
-    layerNum = printerState["layer_num"] | 0;
+  lastModeJudgmentTime = millis();
+  Serial.print(F("打印状态："));
+  Serial.print(gcodeState);
+  Serial.print(F("，进度："));
+  Serial.print(printPercent);
+  Serial.print(F("%，剩余时间："));
+  Serial.print(remainingTime);
+  Serial.println(F(" 分钟"));
+}
 
-    if (forcedMode == NONE) {
-      if (isPrinting()) {
-        currentState = PRINTING;
-      } else if (gcodeState == "FAILED") {
-        currentState = ERROR;
-      } else {
-        currentState = CONNECTED_PRINTER;
-      }
-    } else if (forcedMode == PROGRESS) {
-      currentState = PRINTING;
-    } else if (forcedMode == STANDBY) {
-      currentState = CONNECTED_PRINTER;
+// 处理 MQTT 接收缓冲区：先处理内存环形缓冲区，再处理溢出到闪存的记录
+void processMqttRxBuffer() {
+  if (pauseMqttUpdate) {
+    return;
+  }
+
+  char buffer[MQTT_BUFFER_BLOCK_SIZE];
+  size_t bytesRead;
+
+  while (ringPeek(mqttRxRing, buffer, MQTT_BUFFER_BLOCK_SIZE, bytesRead)) {
+    ringDrop(mqttRxRing);
+    if (bytesRead > MQTT_BUFFER_BLOCK_SIZE) {
+      Serial.println(F("消息块过大："));
+      Serial.println(bytesRead);
+      continue;
     }
+    applyMqttReport(buffer, bytesRead);
+    yield();
+  }
 
-    lastModeJudgmentTime = millis();
-    Serial.print(F("打印状态："));
-    Serial.print(gcodeState);
-    Serial.print(F("，进度："));
-    Serial.print(printPercent);
-    Serial.print(F("%，剩余时间："));
-    Serial.print(remainingTime);
-    Serial.println(F(" 分钟"));
+  if (!mqttRxRing.spilled) {
+    return;
+  }
+  if (!LittleFS.exists(MQTT_RX_BUFFER)) {
+    mqttRxRing.spilled = false;
+    return;
+  }
+
+  size_t offset = 0;
+  while (readMqttBufferBlock(MQTT_RX_BUFFER, buffer, MQTT_BUFFER_BLOCK_SIZE, offset, bytesRead)) {
+    applyMqttReport(buffer, bytesRead);
     yield();
   }
 
@@ -811,7 +1010,8 @@ void processMqttRxBuffer() {
   if (file && offset >= file.size()) {
     file.close();
     LittleFS.remove(MQTT_RX_BUFFER);
-    Serial.println(F("MQTT 接收缓冲区已清空"));
+    mqttRxRing.spilled = false;
+    Serial.println(F("MQTT 溢出接收缓冲区已清空"));
   } else if (file) {
     file.close();
   }
@@ -830,10 +1030,10 @@ void setup() {
   delay(100);
 
   strip.begin();
-  strip.setBrightness(globalBrightness);
+  setPixelScale(globalBrightness);
   bool ledOk = true;
-  for (int i = 0; i < LED_COUNT; i++) {
-    strip.setPixelColor(i, strip.Color(255, 255, 255));
+  for (int i = 0; i < (int)strip.numPixels(); i++) {
+    setScaledPixel(i, strip.Color(255, 255, 255));
     strip.show();
     delay(10);
     strip.clear();
@@ -860,15 +1060,18 @@ void setup() {
   Serial.print(fs_info.totalBytes - fs_info.usedBytes);
   Serial.println(F(" 字节"));
 
-  // 初始化 MQTT 缓冲区文件
+  // 初始化 MQTT 缓冲区
   if (LittleFS.exists(MQTT_RX_BUFFER)) {
     LittleFS.remove(MQTT_RX_BUFFER);
   }
   if (LittleFS.exists(MQTT_TX_BUFFER)) {
     LittleFS.remove(MQTT_TX_BUFFER);
   }
+  ringReset(mqttRxRing);
+  ringReset(mqttTxRing);
 
   loadConfig();
+  applyStripConfig();
   initStaticHtml();
 
   WiFiManagerParameter custom_uid("uid", "用户ID", uid, 32);
@@ -917,10 +1120,13 @@ void setup() {
     espClient.setInsecure();
     mqttClient.setServer(MQTT_SERVER, MQTT_PORT);
     mqttClient.setCallback(mqttCallback);
+    mqttClient.setStream(reportTokenizer);
   } else {
     Serial.println(F("配置为空，跳过 MQTT 初始化"));
   }
 
+  static const char* collectedHeaders[] = { "If-None-Match" };
+  server.collectHeaders(collectedHeaders, 1);
   server.on("/", handleRoot);
   server.on("/config", handleConfig);
   server.on("/testLed", handleTestLed);
@@ -964,6 +1170,8 @@ void loop() {
       lastModeJudgmentTime = millis();
       reconnectMQTT();
     } else {
+      // PubSubClient 在一次 loop() 里读完整个包并触发回调；调用前分词器里还有数据，说明上一个包读到一半就失败了
+      reportTokenizer.reset();
       mqttClient.loop();
       if (currentState == CONNECTED_PRINTER && currentMillis - lastMqttResponseTime > mqttResponseTimeout) {
         Serial.println(F("MQTT 响应超时，标记打印机离线"));
@@ -977,16 +1185,14 @@ void loop() {
     processMqttRxBuffer();
   }
 
-  // 发送定时 pushall
-  if (!isWebServing && !pauseMqttUpdate && currentState == CONNECTED_PRINTER && currentMillis - lastPushallTime > customPushallInterval * 1000) {
-    sendPushall();
-    lastPushallTime = currentMillis;
-  } else if (isWebServing && currentState == CONNECTED_PRINTER && currentMillis - lastPushallTime > customPushallInterval * 1000) {
+  // 不再定时 pushall：只有长时间没有收到报告才视为过期
+  if (currentState == CONNECTED_PRINTER && currentMillis - lastMqttResponseTime > customPushallInterval * 1000 &&
+      currentMillis - lastPushallTime > customPushallInterval * 1000) {
     pendingPushall = true;
   }
 
-  // 处理待发送的 pushall
-  if (!isWebServing && !pauseMqttUpdate && pendingPushall && mqttClient.connected()) {
+  // 处理待发送的 pushall（序号断档、过期或发送失败）
+  if (!isWebServing && !pauseMqttUpdate && pendingPushall && mqttClient.connected() && currentMillis - lastPushallTime >= PUSHALL_MIN_INTERVAL) {
     sendPushall();
     pendingPushall = false;
   }
@@ -1070,7 +1276,10 @@ void loadConfig() {
   progressBarBrightnessRatio = doc["progressBarBrightnessRatio"] | 1.0;
   standbyBrightnessRatio = doc["standbyBrightnessRatio"] | 1.0;
   customPushallInterval = doc["customPushallInterval"] | 30;
-  strip.setBrightness(constrain(globalBrightness, 0, 255));
+  ledCount = constrain(doc["ledCount"] | DEFAULT_LED_COUNT, 1, MAX_LED_COUNT);
+  ledPin = constrain(doc["ledPin"] | DEFAULT_LED_PIN, 0, 16);
+  strncpy(ledColorOrder, doc["ledColorOrder"] | "GRB", sizeof(ledColorOrder) - 1);
+  ledColorOrder[sizeof(ledColorOrder) - 1] = '\0';
 }
 
 void saveConfig() {
@@ -1086,6 +1295,9 @@ void saveConfig() {
   doc["progressBarBrightnessRatio"] = progressBarBrightnessRatio;
   doc["standbyBrightnessRatio"] = standbyBrightnessRatio;
   doc["customPushallInterval"] = customPushallInterval;
+  doc["ledCount"] = ledCount;
+  doc["ledPin"] = ledPin;
+  doc["ledColorOrder"] = ledColorOrder;
   File configFile = LittleFS.open("/config.json", "w");
   if (!configFile) {
     Serial.println(F("无法写入配置文件"));
@@ -1117,6 +1329,8 @@ void reconnectMQTT() {
     printerOffline = false;
     Serial.print(F("MQTT 连接成功，订阅主题："));
     Serial.println(topic);
+    reportTokenizer.reset();
+    sequenceSynced = false;
     sendPushall();
     reconnectDelay = 1000;
   } else {
@@ -1130,23 +1344,190 @@ void reconnectMQTT() {
 }
 
 void mqttCallback(char* topic, byte* payload, unsigned int length) {
+  // 负载没有收全（读包中途超时或 JSON 被截断）时分词器里只有半份报告，整份丢弃并请求全量包补齐
+  if (!reportTokenizer.complete()) {
+    Serial.println(F("报告不完整，已丢弃。"));
+    reportTokenizer.reset();
+    pendingPushall = true;
+    return;
+  }
+
+  // 负载已由 reportTokenizer 边收边解析；报告超过缓冲区时 payload 是截断的，这里不再使用
   if (!pauseMqttUpdate) {
-    writeMqttRxBuffer(payload, length);
+    if (reportTokenizer.fields & ReportTokenizer::F_SEQUENCE_ID) {
+      trackReportSequence(reportTokenizer.sequenceId);
+    }
+    char record[160];
+    size_t recordLength = reportTokenizer.toRecord(record, sizeof(record));
+    if (recordLength > 0) {
+      writeMqttRxBuffer(reinterpret_cast<const byte*>(record), recordLength);
+    }
     lastMqttResponseTime = millis();
   }
+  reportTokenizer.reset();
+}
+
+// 序号不连续说明中间丢了增量报告，需要一次全量包重新对齐
+void trackReportSequence(uint32_t seq) {
+  if (seq == pushallSequenceId) {
+    // 全量包应答带回的是我们发出的序号，之后以下一条报告重新对齐
+    sequenceSynced = false;
+    return;
+  }
+  if (sequenceSynced && seq != lastSequenceId && seq != lastSequenceId + 1) {
+    Serial.print(F("报告序号断档："));
+    Serial.print(lastSequenceId);
+    Serial.print(F(" -> "));
+    Serial.println(seq);
+    pendingPushall = true;
+  }
+  lastSequenceId = seq;
+  sequenceSynced = true;
+}
+
+void ReportTokenizer::reset() {
+  gcodeState[0] = '\0';
+  mcPercent = remainingTime = layerNum = 0;
+  sequenceId = 0;
+  fields = 0;
+  depth = 0;
+  arrayBits = 0;
+  inString = escaped = readingKey = expectKey = inPrint = closed = false;
+  target = 0;
+  keyLen = valueLen = 0;
+  key[0] = '\0';
+}
+
+uint8_t ReportTokenizer::fieldForKey() const {
+  if (strcmp(key, "gcode_state") == 0) return F_GCODE_STATE;
+  if (strcmp(key, "mc_percent") == 0) return F_MC_PERCENT;
+  if (strcmp(key, "mc_remaining_time") == 0) return F_REMAINING_TIME;
+  if (strcmp(key, "layer_num") == 0) return F_LAYER_NUM;
+  if (strcmp(key, "sequence_id") == 0) return F_SEQUENCE_ID;
+  return 0;
+}
+
+void ReportTokenizer::appendValue(char c) {
+  if (target && valueLen < sizeof(value) - 1) value[valueLen++] = c;
+}
+
+void ReportTokenizer::endValue() {
+  if (!target) return;
+  value[valueLen] = '\0';
+  switch (target) {
+    case F_GCODE_STATE: strlcpy(gcodeState, value, sizeof(gcodeState)); break;
+    case F_MC_PERCENT: mcPercent = atol(value); break;
+    case F_REMAINING_TIME: remainingTime = atol(value); break;
+    case F_LAYER_NUM: layerNum = atol(value); break;
+    case F_SEQUENCE_ID: sequenceId = strtoul(value, nullptr, 10); break;
+  }
+  fields |= target;
+  target = 0;
+  valueLen = 0;
+}
+
+size_t ReportTokenizer::write(uint8_t c) {
+  if (inString) {
+    if (escaped) {
+      escaped = false;
+    } else if (c == '\\') {
+      escaped = true;
+      return 1;
+    } else if (c == '"') {
+      inString = false;
+      if (readingKey) {
+        readingKey = false;
+        key[keyLen] = '\0';
+      } else {
+        endValue();
+      }
+      return 1;
+    }
+    if (!readingKey) {
+      appendValue(c);
+    } else if (keyLen < sizeof(key) - 1) {
+      key[keyLen++] = c;
+    } else {
+      key[0] = '\0';  // 超长的键不可能是关心的字段
+      keyLen = 0;
+    }
+    return 1;
+  }
+
+  switch (c) {
+    case '"':
+      inString = true;
+      readingKey = expectKey;
+      keyLen = 0;
+      break;
+    case '{':
+    case '[':
+      if (c == '{' && depth == 1 && strcmp(key, "print") == 0) inPrint = true;
+      target = 0;
+      if (depth < 32) {
+        if (c == '[') arrayBits |= 1UL << depth;
+        else arrayBits &= ~(1UL << depth);
+      }
+      if (depth < 255) depth++;
+      expectKey = (c == '{');
+      break;
+    case '}':
+    case ']':
+      endValue();
+      if (depth > 0 && --depth == 0) closed = true;
+      if (depth < 2) inPrint = false;
+      expectKey = false;
+      break;
+    case ':':
+      expectKey = false;
+      target = (inPrint && depth == 2) ? fieldForKey() : 0;
+      valueLen = 0;
+      break;
+    case ',':
+      endValue();
+      expectKey = depth > 0 && depth <= 32 && !(arrayBits & (1UL << (depth - 1)));
+      break;
+    case ' ':
+    case '\t':
+    case '\r':
+    case '\n':
+      break;
+    default:
+      appendValue(c);  // 数字、true/false/null 等标量
+      break;
+  }
+  return 1;
+}
+
+// 把提取到的字段写成 {"print":{...}}，没有状态字段时返回 0
+size_t ReportTokenizer::toRecord(char* out, size_t size) const {
+  if (!(fields & (F_GCODE_STATE | F_MC_PERCENT | F_REMAINING_TIME | F_LAYER_NUM))) return 0;
+  int n = snprintf(out, size, "{\"print\":{");
+  const char* sep = "";
+  if (fields & F_GCODE_STATE) { n += snprintf(out + n, size - n, "%s\"gcode_state\":\"%s\"", sep, gcodeState); sep = ","; }
+  if (fields & F_MC_PERCENT) { n += snprintf(out + n, size - n, "%s\"mc_percent\":%ld", sep, (long)mcPercent); sep = ","; }
+  if (fields & F_REMAINING_TIME) { n += snprintf(out + n, size - n, "%s\"mc_remaining_time\":%ld", sep, (long)remainingTime); sep = ","; }
+  if (fields & F_LAYER_NUM) { n += snprintf(out + n, size - n, "%s\"layer_num\":%ld", sep, (long)layerNum); }
+  n += snprintf(out + n, size - n, "}}");
+  return (n > 0 && (size_t)n < size) ? n : 0;
 }
 
 void sendPushall() {
   JsonDocument pushall_request;
-  pushall_request["pushing"]["sequence_id"] = String(millis());
+  lastPushallTime = millis();
+  pushallSequenceId = lastPushallTime;
+  pushall_request["pushing"]["sequence_id"] = String(pushallSequenceId);
   pushall_request["pushing"]["command"] = "pushall";
   pushall_request["pushing"]["version"] = 1;
   pushall_request["pushing"]["push_target"] = 1;
   char payload[256];
   size_t length = serializeJson(pushall_request, payload, sizeof(payload));
   writeMqttTxBuffer(payload, length);
+  flushMqttTxBuffer();
+}
 
-  size_t offset = 0;
+// 发送 MQTT 发送缓冲区中的记录：先发送内存环形缓冲区，再发送溢出到闪存的记录
+void flushMqttTxBuffer() {
   char buffer[MQTT_BUFFER_BLOCK_SIZE];
   size_t bytesRead;
   char topicPub[64];
@@ -1154,6 +1535,31 @@ void sendPushall() {
   String topic = String(topicPub).c_str();
   topic.replace("{DEVICE_ID}", deviceID);
 
+  while (ringPeek(mqttTxRing, buffer, MQTT_BUFFER_BLOCK_SIZE, bytesRead)) {
+    if (bytesRead <= MQTT_BUFFER_BLOCK_SIZE) {
+      if (!mqttClient.publish(topic.c_str(), (const uint8_t*)buffer, bytesRead, true)) {
+        Serial.println(F("发送 pushall 请求失败"));
+        pendingPushall = true;
+        return;
+      }
+      Serial.print(F("发送 pushall 请求到 "));
+      Serial.print(topic);
+      Serial.print(F("，长度："));
+      Serial.println(bytesRead);
+    }
+    ringDrop(mqttTxRing);
+    yield();
+  }
+
+  if (!mqttTxRing.spilled) {
+    return;
+  }
+  if (!LittleFS.exists(MQTT_TX_BUFFER)) {
+    mqttTxRing.spilled = false;
+    return;
+  }
+
+  size_t offset = 0;
   while (readMqttBufferBlock(MQTT_TX_BUFFER, buffer, MQTT_BUFFER_BLOCK_SIZE, offset, bytesRead)) {
     if (mqttClient.publish(topic.c_str(), (const uint8_t*)buffer, bytesRead, true)) {
       Serial.print(F("发送 pushall 请求到 "));
@@ -1173,88 +1579,134 @@ void sendPushall() {
   if (file && offset >= file.size()) {
     file.close();
     LittleFS.remove(MQTT_TX_BUFFER);
-    Serial.println(F("MQTT 发送缓冲区已清空"));
+    mqttTxRing.spilled = false;
+    Serial.println(F("MQTT 溢出发送缓冲区已清空"));
   } else if (file) {
     file.close();
   }
 }
 
-uint32_t getRainbowColor(float position) {
-  position = fmod(position, 1.0);
-  if (position < 0.166) return strip.Color(255, 0, 255 * (position / 0.166));
-  else if (position < 0.333) return strip.Color(255 * (1 - (position - 0.166) / 0.166), 255 * ((position - 0.166) / 0.166), 0);
-  else if (position < 0.5) return strip.Color(0, 255, 255 * (1 - (position - 0.333) / 0.166));
-  else if (position < 0.666) return strip.Color(255 * ((position - 0.5) / 0.166), 255 * (1 - (position - 0.5) / 0.166), 0);
-  else if (position < 0.833) return strip.Color(255, 0, 255 * ((position - 0.666) / 0.166));
-  else return strip.Color(255 * (1 - (position - 0.833) / 0.166), 0, 255);
+int findColorOrder(const char* name) {
+  for (uint8_t i = 0; i < COLOR_ORDER_COUNT; i++) {
+    if (strcmp(name, COLOR_ORDER_NAMES[i]) == 0) return i;
+  }
+  return -1;
+}
+
+// 启动时按配置设置灯带长度、引脚和颜色顺序，像素缓冲区只在这里分配一次
+void applyStripConfig() {
+  int order = findColorOrder(ledColorOrder);
+  strip.clear();
+  strip.show();
+  strip.updateType(COLOR_ORDER_TYPES[order < 0 ? 0 : order] + NEO_KHZ800);
+  strip.updateLength(ledCount);
+  if (strip.numPixels() != ledCount) {
+    Serial.println(F("灯带缓冲区分配失败，使用默认长度"));
+    ledCount = DEFAULT_LED_COUNT;
+    strip.updateLength(ledCount);
+    if (strip.numPixels() != ledCount) {
+      // 连默认长度都分配不了时灯带长度为 0，updateLED 和测试灯都不再输出
+      Serial.println(F("灯带缓冲区分配失败，灯效已停用"));
+      return;
+    }
+  }
+  strip.setPin(ledPin);
+  Serial.print(F("灯带已配置：")); Serial.print(ledCount);
+  Serial.print(F(" 颗，GPIO")); Serial.print(ledPin);
+  Serial.print(F("，颜色顺序 ")); Serial.println(ledColorOrder);
+}
+
+// 亮度在写像素时一次性乘上，灯带自身亮度固定为 255，避免 setBrightness 反复有损地缩放缓冲区
+void setPixelScale(int brightness) {
+  pixelScale = constrain(brightness, 0, 255) + 1;
+}
+
+void setScaledPixel(uint16_t index, uint32_t color) {
+  uint8_t r = (((color >> 16) & 0xFF) * pixelScale) >> 8;
+  uint8_t g = (((color >> 8) & 0xFF) * pixelScale) >> 8;
+  uint8_t b = ((color & 0xFF) * pixelScale) >> 8;
+  strip.setPixelColor(index, r, g, b);
+}
+
+// hue 为色环位置（0-255），颜色已做过 gamma 校正
+uint32_t getRainbowColor(uint8_t hue) {
+  return pgm_read_dword(&RAINBOW_LUT[hue]);
+}
+
+// 由四分之一周期表还原完整正弦，phase 0-255 对应一个周期，输出 1-255
+uint8_t lutSine8(uint8_t phase) {
+  uint8_t idx = phase & 63;
+  uint8_t q = (phase & 64) ? pgm_read_byte(&QUARTER_SINE_LUT[64 - idx]) : pgm_read_byte(&QUARTER_SINE_LUT[idx]);
+  return (phase & 128) ? 128 - q : 128 + q;
 }
 
 void updateLED() {
   static unsigned long lastUpdate = 0;
   if (millis() - lastUpdate < ledUpdateInterval || pauseLedUpdate) return;
+  if (strip.numPixels() == 0) return;   // 灯带缓冲区分配失败，灯效已停用
   lastUpdate = millis();
   lastLedProcessTime = millis();
   if (testingLed) return;
   strip.clear();
+  setPixelScale(globalBrightness);
+  const int pixelCount = strip.numPixels();
 
   if (currentState == AP_MODE) {
     apClientConnected = WiFi.softAPgetStationNum() > 0;
-    strip.setPixelColor(0, apClientConnected ? strip.Color(0, 255, 0) : ((millis() / 500) % 2 ? strip.Color(255, 255, 0) : strip.Color(0, 255, 0)));
+    setScaledPixel(0, apClientConnected ? strip.Color(0, 255, 0) : ((millis() / 500) % 2 ? strip.Color(255, 255, 0) : strip.Color(0, 255, 0)));
   } else if (currentState == CONNECTING_WIFI || currentState == CONNECTING_PRINTER) {
-    strip.setPixelColor(0, (millis() / 500) % 2 ? strip.Color(255, 0, 0) : strip.Color(0, 0, 255));
+    setScaledPixel(0, (millis() / 500) % 2 ? strip.Color(255, 0, 0) : strip.Color(0, 0, 255));
   } else if (currentState == CONNECTED_WIFI) {
-    strip.setPixelColor(0, strip.Color(0, 0, 255));
-    strip.setPixelColor(1, (millis() / 500) % 2 ? strip.Color(255, 0, 0) : 0);
+    setScaledPixel(0, strip.Color(0, 0, 255));
+    setScaledPixel(1, (millis() / 500) % 2 ? strip.Color(255, 0, 0) : 0);
   } else if (currentState == CONNECTED_PRINTER || currentState == PRINTING) {
     if (currentState == PRINTING) {
-      float pixels = printPercent * LED_COUNT / 100.0;
+      setPixelScale(globalBrightness * progressBarBrightnessRatio);
+      float pixels = printPercent * pixelCount / 100.0;
       int fullPixels = floor(pixels);
       float partialPixel = pixels - fullPixels;
       for (int i = 0; i < fullPixels; i++) {
-        strip.setPixelColor(i, progressBarColor);
+        setScaledPixel(i, progressBarColor);
       }
-      if (fullPixels < LED_COUNT && partialPixel > 0) {
+      if (fullPixels < pixelCount && partialPixel > 0) {
         uint8_t r = (progressBarColor >> 16) & 0xFF;
         uint8_t g = (progressBarColor >> 8) & 0xFF;
         uint8_t b = progressBarColor & 0xFF;
-        strip.setPixelColor(fullPixels, strip.Color(r * partialPixel, g * partialPixel, b * partialPixel));
+        uint16_t level = pgm_read_byte(&GAMMA_LUT[(uint8_t)(partialPixel * 255)]) + 1;
+        setScaledPixel(fullPixels, strip.Color((r * level) >> 8, (g * level) >> 8, (b * level) >> 8));
       }
-      strip.setBrightness(constrain(globalBrightness * progressBarBrightnessRatio, 0, 255));
-      
+
       if (overlayMarquee) {
         for (int i = 0; i <= fullPixels; i++) {
-          float pos = (float)(i + marqueePosition) / LED_COUNT;
-          uint32_t rainbowColor = getRainbowColor(pos);
+          uint32_t rainbowColor = getRainbowColor(((i + marqueePosition) % pixelCount) * 256 / pixelCount);
           uint8_t r = (rainbowColor >> 16) & 0xFF;
           uint8_t g = (rainbowColor >> 8) & 0xFF;
           uint8_t b = rainbowColor & 0xFF;
           uint8_t pr = (progressBarColor >> 16) & 0xFF;
           uint8_t pg = (progressBarColor >> 8) & 0xFF;
           uint8_t pb = progressBarColor & 0xFF;
-          strip.setPixelColor(i, strip.Color((r + pr) / 2, (g + pg) / 2, (b + pb) / 2));
+          setScaledPixel(i, strip.Color((r + pr) / 2, (g + pg) / 2, (b + pb) / 2));
         }
-        marqueePosition = (marqueePosition + 1) % LED_COUNT;
+        marqueePosition = (marqueePosition + 1) % pixelCount;
       }
     } else {
       if (strcmp(standbyMode, "marquee") == 0) {
-        for (int i = 0; i < LED_COUNT; i++) {
-          float pos = (float)(i + marqueePosition) / LED_COUNT;
-          strip.setPixelColor(i, getRainbowColor(pos));
+        setPixelScale(globalBrightness * standbyBrightnessRatio);
+        for (int i = 0; i < pixelCount; i++) {
+          setScaledPixel(i, getRainbowColor(((i + marqueePosition) % pixelCount) * 256 / pixelCount));
         }
-        marqueePosition = (marqueePosition + 1) % LED_COUNT;
-        strip.setBrightness(constrain(globalBrightness * standbyBrightnessRatio, 0, 255));
+        marqueePosition = (marqueePosition + 1) % pixelCount;
       } else if (strcmp(standbyMode, "breathing") == 0) {
-        float brightness = (sin(millis() / 1000.0 * PI) + 1) / 2.0;
-        int scaledBrightness = brightness * globalBrightness * standbyBrightnessRatio;
-        for (int i = 0; i < LED_COUNT; i++) {
-          strip.setPixelColor(i, standbyBreathingColor);
+        uint8_t wave = lutSine8((uint8_t)(((millis() % 2000) << 8) / 2000));
+        setPixelScale(pgm_read_byte(&GAMMA_LUT[wave]) * globalBrightness * standbyBrightnessRatio / 255);
+        for (int i = 0; i < pixelCount; i++) {
+          setScaledPixel(i, standbyBreathingColor);
         }
-        strip.setBrightness(constrain(scaledBrightness, 0, 255));
       }
     }
   } else if (currentState == ERROR) {
-    for (int i = 0; i < LED_COUNT; i++) {
-      strip.setPixelColor(i, (millis() / 500) % 2 ? strip.Color(255, 0, 0) : 0);
+    for (int i = 0; i < pixelCount; i++) {
+      setScaledPixel(i, (millis() / 500) % 2 ? strip.Color(255, 0, 0) : 0);
     }
   }
   strip.show();
@@ -1266,8 +1718,9 @@ void updateTestLed() {
   lastTestLedUpdate = millis();
   lastLedProcessTime = millis();
   strip.clear();
-  if (testLedIndex < LED_COUNT) {
-    strip.setPixelColor(testLedIndex, strip.Color(255, 255, 255));
+  setPixelScale(globalBrightness);
+  if (testLedIndex < (int)strip.numPixels()) {
+    setScaledPixel(testLedIndex, strip.Color(255, 255, 255));
     strip.show();
     testLedIndex++;
   } else {
@@ -1302,6 +1755,17 @@ void handleRoot() {
     return;
   }
 
+  // 浏览器缓存的页面仍是当前版本时直接回 304，不读文件，也不暂停 LED 和 MQTT
+  if (indexEtag[0] != '\0') {
+    if (server.header("If-None-Match") == indexEtag) {
+      server.sendHeader("ETag", indexEtag);
+      server.sendHeader("Cache-Control", "no-cache");
+      server.send(304);
+      return;
+    }
+    server.sendHeader("ETag", indexEtag);
+    server.sendHeader("Cache-Control", "no-cache");
+  }
   sendFileInChunks("/index.html");
 }
 
@@ -1328,6 +1792,10 @@ void handleConfig() {
     float newSbr = server.arg("standbyBrightnessRatio").toFloat();
     int newPushallInterval = server.arg("customPushallInterval").toInt();
     bool newOverlayMarquee = server.hasArg("overlayMarquee") && server.arg("overlayMarquee") == "on";
+    int newLedCount = server.hasArg("ledCount") ? server.arg("ledCount").toInt() : ledCount;
+    int newLedPin = server.hasArg("ledPin") ? server.arg("ledPin").toInt() : ledPin;
+    String newLedColorOrder = server.hasArg("ledColorOrder") ? server.arg("ledColorOrder") : String(ledColorOrder);
+    newLedColorOrder.toUpperCase();
 
     if (newUid.length() == 0 || newAccessToken.length() == 0 || newDeviceID.length() == 0) {
       String response = F("<script>alert('用户ID、访问令牌和设备序列号不能为空！'); window.location.href='/';</script>");
@@ -1361,6 +1829,14 @@ void handleConfig() {
       pauseMqttUpdate = false;
       return;
     }
+    if (newLedCount < 1 || newLedCount > MAX_LED_COUNT || newLedPin < 0 || newLedPin > 16 || findColorOrder(newLedColorOrder.c_str()) < 0) {
+      String response = F("<script>alert('灯带参数无效：数量 1-1024，引脚 0-16，颜色顺序为 RGB 三个字母的排列！'); window.location.href='/';</script>");
+      server.send(400, "text/html; charset=utf-8", response);
+      isWebServing = false;
+      pauseLedUpdate = false;
+      pauseMqttUpdate = false;
+      return;
+    }
     if (!newProgressBarColor.startsWith("#") || newProgressBarColor.length() != 7) {
       String response = F("<script>alert('进度条颜色格式无效，必须为 #RRGGBB！'); window.location.href='/';</script>");
       server.send(400, "text/html; charset=utf-8", response);
@@ -1391,6 +1867,11 @@ void handleConfig() {
     progressBarBrightnessRatio = newPbr;
     standbyBrightnessRatio = newSbr;
     customPushallInterval = newPushallInterval;
+    // 灯带参数只写入配置，重启后才会按新长度重新分配像素缓冲区
+    ledCount = newLedCount;
+    ledPin = newLedPin;
+    strncpy(ledColorOrder, newLedColorOrder.c_str(), sizeof(ledColorOrder) - 1);
+    ledColorOrder[sizeof(ledColorOrder) - 1] = '\0';
 
     // 转换颜色值
     unsigned long progressBarColorValue = strtoul(newProgressBarColor.substring(1).c_str(), NULL, 16);
@@ -1398,7 +1879,6 @@ void handleConfig() {
     unsigned long standbyBreathingColorValue = strtoul(newStandbyBreathingColor.substring(1).c_str(), NULL, 16);
     standbyBreathingColor = strip.Color((standbyBreathingColorValue >> 16) & 0xFF, (standbyBreathingColorValue >> 8) & 0xFF, standbyBreathingColorValue & 0xFF);
 
-    strip.setBrightness(globalBrightness);
     saveConfig();
     initStaticHtml();
 
@@ -1491,6 +1971,8 @@ void handleClearCache() {
   if (LittleFS.exists(MQTT_TX_BUFFER)) {
     LittleFS.remove(MQTT_TX_BUFFER);
   }
+  ringReset(mqttRxRing);
+  ringReset(mqttTxRing);
   String response = F("<script>alert('缓存已清除！'); window.location.href='/';</script>");
   server.send(200, "text/html; charset=utf-8", response);
   isWebServing = false;
@@ -1521,7 +2003,9 @@ void handleResetConfig() {
   progressBarBrightnessRatio = 1.0;
   standbyBrightnessRatio = 1.0;
   customPushallInterval = 30;
-  strip.setBrightness(globalBrightness);
+  ledCount = DEFAULT_LED_COUNT;
+  ledPin = DEFAULT_LED_PIN;
+  strcpy(ledColorOrder, "GRB");
   saveConfig();
   initStaticHtml();
   String response = F("<script>alert('配置已重置，设备将重启！'); window.location.href='/';</script>");